@@ -0,0 +1,344 @@
+#include "BrickedImage3D.hpp"
+
+
+#include "Parallel.hpp"
+#include "BufferPool.hpp"
+#include "Processing/BrickedFilters.hpp"
+
+#include <cstring>
+
+
+//Spread the low 21 bits of v so there are two zero bits between each of them
+static uint64_t SpreadBits3(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffULL;
+	v = (v | v << 16) & 0x1f0000ff0000ffULL;
+	v = (v | v << 8) & 0x100f00f00f00f00fULL;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ULL;
+	v = (v | v << 2) & 0x1249249249249249ULL;
+	return v;
+}
+
+static uint64_t MortonCode(uint64_t x, uint64_t y, uint64_t z)
+{
+	return SpreadBits3(x) | SpreadBits3(y) << 1 | SpreadBits3(z) << 2;
+}
+
+BrickedImage3D::BrickedImage3D()
+{
+	width = 0;
+	height = 0;
+	depth = 0;
+	pixelSize = 0;
+	pixelType = PIXEL_TYPE_RAW;
+	brickShift = 0;
+	bricksX = 0;
+	bricksY = 0;
+	bricksZ = 0;
+	order = BRICK_ORDER_LINEAR;
+	data = NULL;
+}
+
+BrickedImage3D::~BrickedImage3D()
+{
+	Deallocate();
+}
+
+BrickedImage3D::BrickedImage3D(BrickedImage3D&& other) : BrickedImage3D()
+{
+	Swap(other);
+}
+
+BrickedImage3D& BrickedImage3D::operator=(BrickedImage3D&& other)
+{
+	if(this != &other)
+	{
+		Deallocate();
+		Swap(other);
+	}
+	return *this;
+}
+
+bool BrickedImage3D::Allocate(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type, uint64_t brickSize, BRICK_ORDER brickOrder)
+{
+	if(type == PIXEL_TYPE_RAW)
+	{
+		std::cout << "BrickedImage3D: only single channel images can be bricked" << std::endl;
+		return false;
+	}
+
+	uint64_t shift = 0;
+	while(((uint64_t)1 << shift) < brickSize)
+		shift++;
+	if(((uint64_t)1 << shift) != brickSize || shift < 2 || shift > 6)
+	{
+		std::cout << "BrickedImage3D: brick size must be a power of two between 4 and 64" << std::endl;
+		return false;
+	}
+
+	Deallocate();
+
+	width = W;
+	height = H;
+	depth = D;
+	pixelType = type;
+	pixelSize = PixelTypeSize(type);
+	brickShift = shift;
+	bricksX = (W + brickSize - 1) / brickSize;
+	bricksY = (H + brickSize - 1) / brickSize;
+	bricksZ = (D + brickSize - 1) / brickSize;
+	order = brickOrder;
+
+	uint64_t count = bricksX * bricksY * bricksZ;
+	this->brickOrder.resize(count);
+	brickIndex.resize(count);
+	for(uint64_t i = 0; i < count; i++)
+		this->brickOrder[i] = i;
+
+	//storage slots follow the morton code of the brick coordinates, bricks outside the volume are not
+	//allocated so the codes are sorted rather than used as slots directly
+	if(order == BRICK_ORDER_MORTON)
+	{
+		std::vector<uint64_t> codes(count);
+		for(uint64_t i = 0; i < count; i++)
+			codes[i] = MortonCode(i % bricksX, (i / bricksX) % bricksY, i / (bricksX * bricksY));
+		std::sort(this->brickOrder.begin(), this->brickOrder.end(), [&](uint64_t a, uint64_t b){ return codes[a] < codes[b]; });
+	}
+
+	for(uint64_t slot = 0; slot < count; slot++)
+		brickIndex[this->brickOrder[slot]] = slot;
+
+	data = BufferPool::Acquire(ByteSize());
+	return true;
+}
+
+void BrickedImage3D::Deallocate()
+{
+	if(data != NULL)
+		BufferPool::Release(data, ByteSize());
+
+	width = 0;
+	height = 0;
+	depth = 0;
+	pixelSize = 0;
+	pixelType = PIXEL_TYPE_RAW;
+	brickShift = 0;
+	bricksX = 0;
+	bricksY = 0;
+	bricksZ = 0;
+	brickIndex.clear();
+	brickOrder.clear();
+	data = NULL;
+}
+
+void BrickedImage3D::Swap(BrickedImage3D& other)
+{
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(depth, other.depth);
+	std::swap(pixelSize, other.pixelSize);
+	std::swap(pixelType, other.pixelType);
+	std::swap(brickShift, other.brickShift);
+	std::swap(bricksX, other.bricksX);
+	std::swap(bricksY, other.bricksY);
+	std::swap(bricksZ, other.bricksZ);
+	std::swap(order, other.order);
+	brickIndex.swap(other.brickIndex);
+	brickOrder.swap(other.brickOrder);
+	std::swap(data, other.data);
+}
+
+bool BrickedImage3D::FromImage3D(Image3D& inImg, uint64_t brickSize, BRICK_ORDER brickOrder)
+{
+	if(!Allocate(inImg.Width(), inImg.Height(), inImg.Depth(), inImg.Type(), brickSize, brickOrder))
+		return false;
+
+	unsigned char* in = (unsigned char*)inImg.Data();
+	unsigned char* out = (unsigned char*)data;
+	uint64_t b = brickSize;
+
+	//one task per brick, every brick row is one memcpy from the linear image, the padding is left alone
+	ParallelFor(0, BrickCount(), [&](uint64_t idBegin, uint64_t idEnd)
+	{
+		for(uint64_t id = idBegin; id < idEnd; id++)
+		{
+			uint64_t x0 = (id % bricksX) * b;
+			uint64_t y0 = ((id / bricksX) % bricksY) * b;
+			uint64_t z0 = (id / (bricksX * bricksY)) * b;
+			uint64_t rowLength = std::min(b, width - x0);
+			unsigned char* brick = out + (brickIndex[id] << (3 * brickShift)) * pixelSize;
+
+			for(uint64_t lz = 0; lz < b && z0 + lz < depth; lz++)
+			{
+				for(uint64_t ly = 0; ly < b && y0 + ly < height; ly++)
+				{
+					unsigned char* src = in + (((z0 + lz) * height + y0 + ly) * width + x0) * pixelSize;
+					memcpy(brick + (lz * b + ly) * b * pixelSize, src, rowLength * pixelSize);
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+bool BrickedImage3D::ToImage3D(Image3D& outImg)
+{
+	if(data == NULL)
+		return false;
+
+	outImg.Deallocate();
+	outImg.Allocate(width, height, depth, pixelType);
+
+	unsigned char* in = (unsigned char*)data;
+	unsigned char* out = (unsigned char*)outImg.Data();
+	uint64_t b = BrickSize();
+
+	ParallelFor(0, BrickCount(), [&](uint64_t idBegin, uint64_t idEnd)
+	{
+		for(uint64_t id = idBegin; id < idEnd; id++)
+		{
+			uint64_t x0 = (id % bricksX) * b;
+			uint64_t y0 = ((id / bricksX) % bricksY) * b;
+			uint64_t z0 = (id / (bricksX * bricksY)) * b;
+			uint64_t rowLength = std::min(b, width - x0);
+			unsigned char* brick = in + (brickIndex[id] << (3 * brickShift)) * pixelSize;
+
+			for(uint64_t lz = 0; lz < b && z0 + lz < depth; lz++)
+			{
+				for(uint64_t ly = 0; ly < b && y0 + ly < height; ly++)
+				{
+					unsigned char* dst = out + (((z0 + lz) * height + y0 + ly) * width + x0) * pixelSize;
+					memcpy(dst, brick + (lz * b + ly) * b * pixelSize, rowLength * pixelSize);
+				}
+			}
+		}
+	});
+
+	return true;
+}
+
+void* BrickedImage3D::Data()
+{
+	return data;
+}
+
+uint64_t BrickedImage3D::Width()
+{
+	return width;
+}
+
+uint64_t BrickedImage3D::Height()
+{
+	return height;
+}
+
+uint64_t BrickedImage3D::Depth()
+{
+	return depth;
+}
+
+PIXEL_TYPE BrickedImage3D::Type()
+{
+	return pixelType;
+}
+
+uint64_t BrickedImage3D::BrickSize()
+{
+	return (uint64_t)1 << brickShift;
+}
+
+uint64_t BrickedImage3D::BrickCount()
+{
+	return bricksX * bricksY * bricksZ;
+}
+
+uint64_t BrickedImage3D::ByteSize()
+{
+	return (BrickCount() << (3 * brickShift)) * pixelSize;
+}
+
+void* BrickedImage3D::Brick(uint64_t bx, uint64_t by, uint64_t bz)
+{
+	uint64_t id = (bz * bricksY + by) * bricksX + bx;
+	return (unsigned char*)data + (brickIndex[id] << (3 * brickShift)) * pixelSize;
+}
+
+void* BrickedImage3D::Voxel(uint64_t x, uint64_t y, uint64_t z)
+{
+	uint64_t mask = BrickSize() - 1;
+	unsigned char* brick = (unsigned char*)Brick(x >> brickShift, y >> brickShift, z >> brickShift);
+	return brick + ((((z & mask) << brickShift | (y & mask)) << brickShift) | (x & mask)) * pixelSize;
+}
+
+
+//
+//Neighbourhood filters, dispatched the same way as the linear ones in Image3D.cpp but split over
+//brick slots instead of z slabs
+//
+
+template<template<class, class> class Kernel, class T> static void RunBrickedKernel(BrickedImage3D& inImg, BrickedImage3D& outImg, BOUNDARY_MODE mode)
+{
+	TypedBrickedImage3D<T> in = inImg.Typed<T>();
+	TypedBrickedImage3D<T> out = outImg.Typed<T>();
+
+	ParallelFor(0, inImg.BrickCount(), [&](uint64_t slotBegin, uint64_t slotEnd)
+	{
+		if(mode == BOUNDARY_MIRROR)
+			Kernel<T, BoundaryMirror>::Run(in, out, slotBegin, slotEnd);
+		else if(mode == BOUNDARY_ZERO)
+			Kernel<T, BoundaryZero>::Run(in, out, slotBegin, slotEnd);
+		else
+			Kernel<T, BoundaryClamp>::Run(in, out, slotBegin, slotEnd);
+	});
+}
+
+template<template<class, class> class Kernel> static bool RunBrickedKernel(BrickedImage3D& inImg, BrickedImage3D& outImg, BOUNDARY_MODE mode)
+{
+	switch(inImg.Type())
+	{
+		case PIXEL_TYPE_UINT8:
+			RunBrickedKernel<Kernel, uint8_t>(inImg, outImg, mode);
+			return true;
+		case PIXEL_TYPE_UINT16:
+			RunBrickedKernel<Kernel, uint16_t>(inImg, outImg, mode);
+			return true;
+		case PIXEL_TYPE_INT16:
+			RunBrickedKernel<Kernel, int16_t>(inImg, outImg, mode);
+			return true;
+		case PIXEL_TYPE_FLOAT:
+			RunBrickedKernel<Kernel, float>(inImg, outImg, mode);
+			return true;
+		default:
+			return false;
+	}
+}
+
+void BrickedImage3D::Smooth2D(BOUNDARY_MODE mode)
+{
+	BrickedImage3D outImg;
+	if(outImg.Allocate(width, height, depth, pixelType, BrickSize(), order) && RunBrickedKernel<BrickedSmooth2DKernel>(*this, outImg, mode))
+		Swap(outImg);
+}
+
+void BrickedImage3D::Median2D(BOUNDARY_MODE mode)
+{
+	BrickedImage3D outImg;
+	if(outImg.Allocate(width, height, depth, pixelType, BrickSize(), order) && RunBrickedKernel<BrickedMedian2DKernel>(*this, outImg, mode))
+		Swap(outImg);
+}
+
+void BrickedImage3D::Smooth(BOUNDARY_MODE mode)
+{
+	BrickedImage3D outImg;
+	if(outImg.Allocate(width, height, depth, pixelType, BrickSize(), order) && RunBrickedKernel<BrickedSmoothKernel>(*this, outImg, mode))
+		Swap(outImg);
+}
+
+void BrickedImage3D::Median(BOUNDARY_MODE mode)
+{
+	BrickedImage3D outImg;
+	if(outImg.Allocate(width, height, depth, pixelType, BrickSize(), order) && RunBrickedKernel<BrickedMedianKernel>(*this, outImg, mode))
+		Swap(outImg);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+
+#include "Common.hpp"
+#include "TypedImage3D.hpp"
+#include "Image3D.hpp"
+
+
+//Order the bricks are laid out in memory. MORTON interleaves the brick coordinates so bricks that
+//are close in 3D are also close in memory, which helps kernels that read a neighbouring brick's apron.
+enum BRICK_ORDER{BRICK_ORDER_LINEAR, BRICK_ORDER_MORTON};
+
+
+//
+//TypedBrickedImage3D
+//
+
+
+//Non owning, typed access to a bricked voxel buffer. Every brick is a cube of (1 << brickShift) voxels
+//per side stored contiguously in z-y-x order, brickIndex maps a linear brick id to its storage slot
+//and brickOrder maps a slot back to the linear brick id.
+template<class T> class TypedBrickedImage3D
+{
+	public:
+		typedef T Voxel;
+
+		T* data;
+		const uint64_t* brickIndex;
+		const uint64_t* brickOrder;
+		int64_t width;
+		int64_t height;
+		int64_t depth;
+		int64_t brickShift;
+		int64_t bricksX;
+		int64_t bricksY;
+		int64_t bricksZ;
+
+		inline int64_t BrickSize() const
+		{
+			return (int64_t)1 << brickShift;
+		}
+
+		inline int64_t BrickId(int64_t bx, int64_t by, int64_t bz) const
+		{
+			return (bz * bricksY + by) * bricksX + bx;
+		}
+
+		inline T* Brick(int64_t id) const
+		{
+			return data + (brickIndex[id] << (3 * brickShift));
+		}
+
+		inline T& At(int64_t x, int64_t y, int64_t z) const
+		{
+			int64_t mask = BrickSize() - 1;
+			T* brick = Brick(BrickId(x >> brickShift, y >> brickShift, z >> brickShift));
+			return brick[(((z & mask) << brickShift | (y & mask)) << brickShift) | (x & mask)];
+		}
+};
+
+
+//
+//BrickedImage3D
+//
+
+
+//Single channel volume stored as fixed size bricks. Bricks on the far edges are padded up to the full
+//brick size. Neither FromImage3D nor the filters write the padding and nothing reads it, so its contents
+//are undefined.
+class BrickedImage3D
+{
+	protected:
+		uint64_t width;
+		uint64_t height;
+		uint64_t depth;
+		uint64_t pixelSize;
+		PIXEL_TYPE pixelType;
+		uint64_t brickShift;
+		uint64_t bricksX;
+		uint64_t bricksY;
+		uint64_t bricksZ;
+		BRICK_ORDER order;
+		std::vector<uint64_t> brickIndex;
+		std::vector<uint64_t> brickOrder;
+		void* data;
+
+	public:
+		BrickedImage3D();
+		~BrickedImage3D();
+		BrickedImage3D(BrickedImage3D&& other);
+		BrickedImage3D& operator=(BrickedImage3D&& other);
+		BrickedImage3D(const BrickedImage3D&) = delete;
+		BrickedImage3D& operator=(const BrickedImage3D&) = delete;
+		bool Allocate(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type, uint64_t brickSize = 16, BRICK_ORDER brickOrder = BRICK_ORDER_MORTON);
+		void Deallocate();
+		void Swap(BrickedImage3D& other);
+		bool FromImage3D(Image3D& inImg, uint64_t brickSize = 16, BRICK_ORDER brickOrder = BRICK_ORDER_MORTON);
+		bool ToImage3D(Image3D& outImg);
+		void* Data();
+		uint64_t Width();
+		uint64_t Height();
+		uint64_t Depth();
+		PIXEL_TYPE Type();
+		uint64_t BrickSize();
+		uint64_t BrickCount();
+		uint64_t ByteSize();
+		void* Brick(uint64_t bx, uint64_t by, uint64_t bz);
+		void* Voxel(uint64_t x, uint64_t y, uint64_t z);
+		void Smooth2D(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median2D(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Smooth(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+
+		//typed view of the bricks, T must match Type()
+		template<class T> TypedBrickedImage3D<T> Typed()
+		{
+			TypedBrickedImage3D<T> img;
+			img.data = (T*)data;
+			img.brickIndex = brickIndex.data();
+			img.brickOrder = brickOrder.data();
+			img.width = width;
+			img.height = height;
+			img.depth = depth;
+			img.brickShift = brickShift;
+			img.bricksX = bricksX;
+			img.bricksY = bricksY;
+			img.bricksZ = bricksZ;
+			return img;
+		}
+};
@@ -0,0 +1,202 @@
+#include "BufferPool.hpp"
+
+
+#include <map>
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+
+static const uint64_t pageBytes = (uint64_t)2 << 20;
+
+static std::mutex poolMutex;
+static std::map<uint64_t, std::vector<void*>> idleBuffers;//by size class
+static uint64_t idleBytes = 0;
+static bool settingsSet = false;
+static uint64_t limitBytes = 0;
+static bool hugePages = false;
+
+//first use, pick up the settings from the environment. Called with poolMutex held.
+static void LoadSettings()
+{
+	if(settingsSet)
+		return;
+	
+	const char* limitMB = getenv("VOLUMETRIC_RENDERER_POOL_MB");
+	const char* huge = getenv("VOLUMETRIC_RENDERER_HUGE_PAGES");
+	limitBytes = (uint64_t)(limitMB != NULL ? atoll(limitMB) : 1024) << 20;
+	hugePages = huge != NULL && atoi(huge) != 0;
+	settingsSet = true;
+}
+
+//smallest of 4, 5, 6 or 7 times a power of two that holds bytes
+static uint64_t SizeClass(uint64_t bytes)
+{
+	if(bytes <= 4)
+		return 4;
+	
+	uint64_t step = 1;
+	while(step * 8 <= bytes)
+		step *= 2;
+	return ((bytes + step - 1) / step) * step;
+}
+
+//bytes actually allocated for a class
+static uint64_t AllocationSize(uint64_t sizeClass)
+{
+	if(sizeClass < pageBytes)
+		return sizeClass;
+	return (sizeClass + pageBytes - 1) / pageBytes * pageBytes;
+}
+
+#ifdef _WIN32
+
+static void* AllocateFromOS(uint64_t bytes)
+{
+	return VirtualAlloc(NULL, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+static void FreeToOS(void* buffer, uint64_t bytes)
+{
+	VirtualFree(buffer, 0, MEM_RELEASE);
+}
+
+#else
+
+static void* AllocateFromOS(uint64_t bytes)
+{
+	//map one page more and cut it back to a 2MB aligned range, huge pages need the alignment
+	void* mapped = mmap(NULL, bytes + pageBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mapped == MAP_FAILED)
+		return NULL;
+	
+	uintptr_t begin = (uintptr_t)mapped;
+	uintptr_t aligned = (begin + pageBytes - 1) / pageBytes * pageBytes;
+	if(aligned > begin)
+		munmap(mapped, aligned - begin);
+	munmap((void*)(aligned + bytes), begin + pageBytes - aligned);
+	
+#ifdef MADV_HUGEPAGE
+	if(hugePages)
+		madvise((void*)aligned, bytes, MADV_HUGEPAGE);
+#endif
+	return (void*)aligned;
+}
+
+static void FreeToOS(void* buffer, uint64_t bytes)
+{
+	munmap(buffer, bytes);
+}
+
+#endif
+
+static void FreeBuffer(void* buffer, uint64_t sizeClass)
+{
+	if(sizeClass < pageBytes)
+		delete[] (unsigned char*)buffer;
+	else
+		FreeToOS(buffer, AllocationSize(sizeClass));
+}
+
+void* BufferPool::Acquire(uint64_t bytes)
+{
+	if(bytes == 0)
+		return NULL;
+	
+	uint64_t sizeClass = SizeClass(bytes);
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		LoadSettings();
+		auto entry = idleBuffers.find(sizeClass);
+		if(entry != idleBuffers.end() && !entry->second.empty())
+		{
+			void* buffer = entry->second.back();
+			entry->second.pop_back();
+			idleBytes -= AllocationSize(sizeClass);
+			return buffer;
+		}
+	}
+	
+	if(sizeClass < pageBytes)
+		return new unsigned char[sizeClass];
+	
+	//idle buffers of other classes may be what stands in the way
+	void* buffer = AllocateFromOS(AllocationSize(sizeClass));
+	if(buffer == NULL)
+	{
+		Trim();
+		buffer = AllocateFromOS(AllocationSize(sizeClass));
+	}
+	if(buffer == NULL)
+	{
+		std::cout << "BufferPool: could not allocate " << bytes << " bytes" << std::endl;
+		throw std::bad_alloc();
+	}
+	return buffer;
+}
+
+void BufferPool::Release(void* buffer, uint64_t bytes)
+{
+	if(buffer == NULL)
+		return;
+	
+	uint64_t sizeClass = SizeClass(bytes);
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		LoadSettings();
+		if(idleBytes + AllocationSize(sizeClass) <= limitBytes)
+		{
+			idleBuffers[sizeClass].push_back(buffer);
+			idleBytes += AllocationSize(sizeClass);
+			return;
+		}
+	}
+	
+	FreeBuffer(buffer, sizeClass);
+}
+
+void BufferPool::SetLimit(uint64_t bytes)
+{
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		LoadSettings();
+		limitBytes = bytes;
+		if(idleBytes <= limitBytes)
+			return;
+	}
+	Trim();
+}
+
+void BufferPool::SetHugePages(bool enable)
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	LoadSettings();
+	hugePages = enable;
+}
+
+void BufferPool::Trim()
+{
+	std::map<uint64_t, std::vector<void*>> buffers;
+	{
+		std::lock_guard<std::mutex> lock(poolMutex);
+		buffers.swap(idleBuffers);
+		idleBytes = 0;
+	}
+	
+	for(auto& entry : buffers)
+		for(void* buffer : entry.second)
+			FreeBuffer(buffer, entry.first);
+}
+
+uint64_t BufferPool::IdleBytes()
+{
+	std::lock_guard<std::mutex> lock(poolMutex);
+	return idleBytes;
+}
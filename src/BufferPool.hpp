@@ -0,0 +1,35 @@
+#pragma once
+
+
+#include "Common.hpp"
+
+
+//Process wide pool of image buffers. Released buffers are kept by size class and handed out again to
+//the next request of the same class, so re-imports and repeated preprocessing run on memory that is
+//already paged in instead of faulting in fresh pages every time. Classes are powers of two with
+//quarter steps, at most a quarter of a buffer is slack.
+//
+//Buffers of 2MB and more come straight from the OS (mmap / VirtualAlloc), 2MB aligned so they can be
+//backed by transparent huge pages when those are turned on. Smaller buffers come from new[].
+class BufferPool
+{
+	public:
+		//At least bytes of uninitialised memory, NULL for 0 bytes. Throws std::bad_alloc like new[].
+		static void* Acquire(uint64_t bytes);
+		
+		//bytes must be the value given to Acquire. The buffer goes back to the pool, or to the OS when
+		//the pool would grow past its limit.
+		static void Release(void* buffer, uint64_t bytes);
+		
+		//Idle bytes kept for reuse, until this is called VOLUMETRIC_RENDERER_POOL_MB (default 1024) is used.
+		//0 turns the pool off.
+		static void SetLimit(uint64_t bytes);
+		
+		//Asks for huge pages on buffers allocated from now on (posix only), until this is called
+		//VOLUMETRIC_RENDERER_HUGE_PAGES is used.
+		static void SetHugePages(bool enable);
+		
+		//Returns every idle buffer to the OS
+		static void Trim();
+		static uint64_t IdleBytes();
+};
@@ -43,8 +43,14 @@ ControlPanel::ControlPanel(): QDockWidget("Control Panel")
 	layoutGroup2D->addWidget(scalarChooserContrast);
 	scalarChooserThreshold = new ScalarChooser("Threshold", -1000, 1000.0, 0.0, 0.001, false);
 	layoutGroup2D->addWidget(scalarChooserThreshold);
+	QHBoxLayout* bctButtonLayout = new QHBoxLayout();
+	layoutGroup2D->addLayout(bctButtonLayout); 
 	buttonBrightnessContrastApply = new QPushButton("Apply");
-	layoutGroup2D->addWidget(buttonBrightnessContrastApply); 
+	bctButtonLayout->addWidget(buttonBrightnessContrastApply); 
+	buttonBrightnessContrastUndo = new QPushButton("Undo");
+	bctButtonLayout->addWidget(buttonBrightnessContrastUndo); 
+	buttonBrightnessContrastReset = new QPushButton("Reset");
+	bctButtonLayout->addWidget(buttonBrightnessContrastReset); 
 	
 	//3D Settings	
 	groupBox3D = new QGroupBox("3D Settings");
@@ -88,6 +94,13 @@ ControlPanel::ControlPanel(): QDockWidget("Control Panel")
 	layoutGroup3D->addWidget(checkBackFaceCulling);
 	checkBackFaceCulling->setCheckState(Qt::Checked);
 	
+	comboGradientEncoding = new QComboBox();
+	comboGradientEncoding->addItem("RGB8");
+	comboGradientEncoding->addItem("Octahedral");
+	comboGradientEncoding->addItem("Shader");
+	layoutGroup3D->addWidget(new QLabel("Gradient Encoding"));
+	layoutGroup3D->addWidget(comboGradientEncoding);
+	
 	
 	//mode selection
 	connect(button3D, &QPushButton::clicked, [&, this](bool check){
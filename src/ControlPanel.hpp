@@ -24,6 +24,8 @@ class ControlPanel: public QDockWidget
 		ScalarChooser* scalarChooserBrightness;
 		ScalarChooser* scalarChooserThreshold;
 		QPushButton* buttonBrightnessContrastApply; 
+		QPushButton* buttonBrightnessContrastUndo; 
+		QPushButton* buttonBrightnessContrastReset; 
 		
 		//3d settings
 		QGroupBox* groupBox3D; 
@@ -37,6 +39,7 @@ class ControlPanel: public QDockWidget
 		SampleMappingEditor* sampleMapping;
 		ScalarChooser* chooserGradientThreshold;
 		QCheckBox* checkBackFaceCulling; 
+		QComboBox* comboGradientEncoding; 
 	
 		ControlPanel();
 		
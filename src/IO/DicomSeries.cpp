@@ -0,0 +1,367 @@
+#include <dcmtk/config/osconfig.h>    /* make sure OS specific configuration is included first */
+#include <dcmtk/dcmdata/dctk.h>
+
+#include "DicomSeries.hpp"
+
+#include "../Parallel.hpp"
+
+#include <map>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+
+//Headers only, pixel data above the default read length stays on disk
+static void ReadDicomSliceHeader(std::string fileName, DicomSliceHeader* header)
+{
+	header->valid = false;
+	header->width = 0;
+	header->height = 0;
+	header->frames = 0;
+	header->pixelSpacing[0] = 0;
+	header->pixelSpacing[1] = 0;
+	header->spacingBetweenSlices = 0;
+	header->sliceThickness = 0;
+	header->hasPosition = false;
+	header->hasOrientation = false;
+	header->hasInstanceNumber = false;
+	header->instanceNumber = 0;
+	header->seriesUID.clear();
+	header->samplesPerPixel = 1;
+	header->bitsAllocated = 16;
+	header->bitsStored = 16;
+	header->isSigned = false;
+	header->rescaleSlope = 1;
+	header->rescaleIntercept = 0;
+	
+	DcmFileFormat file;
+	if(file.loadFile(fileName.c_str()).bad())
+		return;
+	DcmDataset* dataset = file.getDataset();
+	
+	Uint16 rows;
+	Uint16 columns;
+	if(dataset->findAndGetUint16(DCM_Rows, rows).bad() || dataset->findAndGetUint16(DCM_Columns, columns).bad())
+		return;
+	header->width = columns;
+	header->height = rows;
+	
+	//single frame files usually leave NumberOfFrames out
+	Sint32 frames;
+	header->frames = dataset->findAndGetSint32(DCM_NumberOfFrames, frames).good() ? std::max<Sint32>(0, frames) : 1;
+	
+	Float64 value;
+	if(dataset->findAndGetFloat64(DCM_PixelSpacing, value, 0).good() && value > 0)
+		header->pixelSpacing[0] = value;
+	if(dataset->findAndGetFloat64(DCM_PixelSpacing, value, 1).good() && value > 0)
+		header->pixelSpacing[1] = value;
+	if(dataset->findAndGetFloat64(DCM_SpacingBetweenSlices, value).good() && value > 0)
+		header->spacingBetweenSlices = value;
+	if(dataset->findAndGetFloat64(DCM_SliceThickness, value).good() && value > 0)
+		header->sliceThickness = value;
+	
+	header->hasPosition = true;
+	for(int i = 0; i < 3; i++)
+		header->hasPosition = header->hasPosition && dataset->findAndGetFloat64(DCM_ImagePositionPatient, header->position[i], i).good();
+	header->hasOrientation = true;
+	for(int i = 0; i < 6; i++)
+		header->hasOrientation = header->hasOrientation && dataset->findAndGetFloat64(DCM_ImageOrientationPatient, header->orientation[i], i).good();
+	
+	Sint32 instance;
+	if(dataset->findAndGetSint32(DCM_InstanceNumber, instance).good())
+	{
+		header->hasInstanceNumber = true;
+		header->instanceNumber = instance;
+	}
+	OFString uid;
+	if(dataset->findAndGetOFString(DCM_SeriesInstanceUID, uid).good())
+		header->seriesUID = uid.c_str();
+	
+	Uint16 bits;
+	if(dataset->findAndGetUint16(DCM_SamplesPerPixel, bits).good())
+		header->samplesPerPixel = bits;
+	if(dataset->findAndGetUint16(DCM_BitsAllocated, bits).good())
+		header->bitsAllocated = bits;
+	header->bitsStored = header->bitsAllocated;
+	if(dataset->findAndGetUint16(DCM_BitsStored, bits).good() && bits > 0 && bits <= header->bitsAllocated)
+		header->bitsStored = bits;
+	if(dataset->findAndGetUint16(DCM_PixelRepresentation, bits).good())
+		header->isSigned = bits == 1;
+	if(dataset->findAndGetFloat64(DCM_RescaleSlope, value).good() && value != 0)
+		header->rescaleSlope = value;
+	if(dataset->findAndGetFloat64(DCM_RescaleIntercept, value).good())
+		header->rescaleIntercept = value;
+	
+	header->valid = dataset->tagExists(DCM_PixelData);
+}
+
+
+//
+//Header index. One text file per directory with a line per file: size, modification time, the header
+//fields, the series UID (- when empty) and the file name up to the end of the line.
+//
+
+
+static const char* indexFileName = ".volumetric_renderer_dicom_index";
+static const char* indexVersion = "VolumetricRendererDicomIndex 1";
+
+struct DicomIndexEntry
+{
+	uint64_t size;
+	int64_t modified;
+	DicomSliceHeader header;
+};
+
+typedef std::map<std::string, DicomIndexEntry> DicomIndex;
+
+static bool FileStamp(const std::string& fileName, uint64_t* size, int64_t* modified)
+{
+	struct stat info;
+	if(stat(fileName.c_str(), &info) != 0)
+		return false;
+	*size = info.st_size;
+	*modified = info.st_mtime;
+	return true;
+}
+
+static void SplitPath(const std::string& fileName, std::string* directory, std::string* name)
+{
+	size_t slash = fileName.find_last_of("/\\");
+	if(slash == std::string::npos)
+	{
+		*directory = ".";
+		*name = fileName;
+	}
+	else
+	{
+		*directory = fileName.substr(0, slash + 1);
+		*name = fileName.substr(slash + 1);
+	}
+}
+
+static std::string IndexPath(const std::string& directory)
+{
+	char last = directory[directory.size() - 1];
+	return last == '/' || last == '\\' ? directory + indexFileName : directory + "/" + indexFileName;
+}
+
+static void WriteIndexEntry(std::ostream& out, const std::string& name, DicomIndexEntry& entry)
+{
+	DicomSliceHeader& h = entry.header;
+	out << entry.size << ' ' << entry.modified << ' ' << h.valid << ' ' << h.width << ' ' << h.height << ' ' << h.frames;
+	out << ' ' << h.pixelSpacing[0] << ' ' << h.pixelSpacing[1] << ' ' << h.spacingBetweenSlices << ' ' << h.sliceThickness;
+	out << ' ' << h.hasPosition;
+	for(int i = 0; i < 3; i++)
+		out << ' ' << (h.hasPosition ? h.position[i] : 0);
+	out << ' ' << h.hasOrientation;
+	for(int i = 0; i < 6; i++)
+		out << ' ' << (h.hasOrientation ? h.orientation[i] : 0);
+	out << ' ' << h.hasInstanceNumber << ' ' << h.instanceNumber << ' ' << h.samplesPerPixel << ' ' << h.bitsAllocated << ' ' << h.bitsStored;
+	out << ' ' << h.isSigned << ' ' << h.rescaleSlope << ' ' << h.rescaleIntercept;
+	out << ' ' << (h.seriesUID.empty() ? "-" : h.seriesUID) << ' ' << name << '\n';
+}
+
+static bool ReadIndexEntry(std::istream& in, std::string* name, DicomIndexEntry* entry)
+{
+	DicomSliceHeader& h = entry->header;
+	in >> entry->size >> entry->modified >> h.valid >> h.width >> h.height >> h.frames;
+	in >> h.pixelSpacing[0] >> h.pixelSpacing[1] >> h.spacingBetweenSlices >> h.sliceThickness;
+	in >> h.hasPosition;
+	for(int i = 0; i < 3; i++)
+		in >> h.position[i];
+	in >> h.hasOrientation;
+	for(int i = 0; i < 6; i++)
+		in >> h.orientation[i];
+	in >> h.hasInstanceNumber >> h.instanceNumber >> h.samplesPerPixel >> h.bitsAllocated >> h.bitsStored;
+	in >> h.isSigned >> h.rescaleSlope >> h.rescaleIntercept >> h.seriesUID;
+	if(h.seriesUID == "-")
+		h.seriesUID.clear();
+	
+	//the name is the rest of the line, it may hold spaces
+	in.get();
+	std::getline(in, *name);
+	return !in.fail() && !name->empty();
+}
+
+static void LoadIndex(const std::string& directory, DicomIndex* index)
+{
+	std::ifstream in(IndexPath(directory).c_str());
+	std::string line;
+	if(!std::getline(in, line) || line != indexVersion)
+		return;
+	
+	std::string name;
+	DicomIndexEntry entry;
+	while(ReadIndexEntry(in, &name, &entry))
+		(*index)[name] = entry;
+}
+
+//Written next to the index and renamed over it, a reader never sees half a file
+static bool SaveIndex(const std::string& directory, DicomIndex& index)
+{
+	std::string path = IndexPath(directory);
+	std::string tempPath = path + ".tmp";
+	{
+		std::ofstream out(tempPath.c_str());
+		if(!out)
+			return false;
+		out << std::setprecision(17) << indexVersion << '\n';
+		for(auto& entry : index)
+			WriteIndexEntry(out, entry.first, entry.second);
+		if(!out)
+			return false;
+	}
+	
+	remove(path.c_str());
+	return rename(tempPath.c_str(), path.c_str()) == 0;
+}
+
+void ReadDicomSliceHeaders(std::vector<std::string>& fileNames, std::vector<DicomSliceHeader>* headers)
+{
+	const char* env = getenv("VOLUMETRIC_RENDERER_DICOM_INDEX");
+	bool useIndex = env == NULL || atoi(env) != 0;
+	
+	headers->resize(fileNames.size());
+	std::vector<std::string> directories(fileNames.size());
+	std::vector<std::string> names(fileNames.size());
+	std::vector<uint64_t> sizes(fileNames.size(), 0);
+	std::vector<int64_t> modified(fileNames.size(), 0);
+	std::vector<bool> stamped(fileNames.size(), false);
+	std::map<std::string, DicomIndex> indices;
+	std::vector<uint64_t> toParse;
+	
+	for(size_t i = 0; i < fileNames.size(); i++)
+	{
+		if(!useIndex)
+		{
+			toParse.push_back(i);
+			continue;
+		}
+		
+		SplitPath(fileNames[i], &directories[i], &names[i]);
+		if(indices.find(directories[i]) == indices.end())
+			LoadIndex(directories[i], &indices[directories[i]]);
+		
+		stamped[i] = FileStamp(fileNames[i], &sizes[i], &modified[i]);
+		DicomIndex& index = indices[directories[i]];
+		auto entry = index.find(names[i]);
+		if(stamped[i] && entry != index.end() && entry->second.size == sizes[i] && entry->second.modified == modified[i])
+			(*headers)[i] = entry->second.header;
+		else
+			toParse.push_back(i);
+	}
+	
+	ParallelFor(0, toParse.size(), [&](uint64_t begin, uint64_t end)
+	{
+		for(uint64_t k = begin; k < end; k++)
+			ReadDicomSliceHeader(fileNames[toParse[k]], &(*headers)[toParse[k]]);
+	});
+	std::cout << "DicomSeries: " << fileNames.size() - toParse.size() << " of " << fileNames.size() << " headers from the index" << std::endl; 
+	
+	if(!useIndex || toParse.empty())
+		return;
+	
+	//the new headers go into the index of their directory, other entries are kept
+	std::map<std::string, bool> changed;
+	for(uint64_t i : toParse)
+	{
+		if(!stamped[i])
+			continue;
+		DicomIndexEntry& entry = indices[directories[i]][names[i]];
+		entry.size = sizes[i];
+		entry.modified = modified[i];
+		entry.header = (*headers)[i];
+		changed[directories[i]] = true;
+	}
+	for(auto& directory : changed)
+		if(!SaveIndex(directory.first, indices[directory.first]))
+			std::cout << "DicomSeries: could not write the header index in " << directory.first << std::endl; 
+}
+
+
+//
+//Series grouping and slice order
+//
+
+
+static void SortSeries(std::vector<DicomSliceHeader>& headers, DicomSeries* series)
+{
+	std::vector<size_t>& files = series->files;
+	series->sliceSpacing = 0;
+	
+	bool havePositions = headers[files[0]].hasOrientation;
+	bool haveInstances = true;
+	for(size_t i : files)
+	{
+		havePositions = havePositions && headers[i].hasPosition;
+		haveInstances = haveInstances && headers[i].hasInstanceNumber;
+	}
+	
+	//the normal of the first slice, the cross product of its row and column directions
+	double normal[3] = {0, 0, 0};
+	if(havePositions)
+	{
+		double* o = headers[files[0]].orientation;
+		normal[0] = o[1] * o[5] - o[2] * o[4];
+		normal[1] = o[2] * o[3] - o[0] * o[5];
+		normal[2] = o[0] * o[4] - o[1] * o[3];
+		double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		havePositions = length > 1e-6;
+		for(int k = 0; k < 3 && havePositions; k++)
+			normal[k] /= length;
+	}
+	
+	if(havePositions)
+	{
+		std::vector<double> distance(headers.size(), 0);
+		for(size_t i : files)
+			distance[i] = headers[i].position[0] * normal[0] + headers[i].position[1] * normal[1] + headers[i].position[2] * normal[2];
+		
+		//slices at the same position keep their instance order
+		std::stable_sort(files.begin(), files.end(), [&](size_t a, size_t b)
+		{
+			if(distance[a] != distance[b])
+				return distance[a] < distance[b];
+			return haveInstances && headers[a].instanceNumber < headers[b].instanceNumber;
+		});
+		if(files.size() > 1)
+			series->sliceSpacing = (distance[files.back()] - distance[files.front()]) / (files.size() - 1);
+	}
+	else if(haveInstances)
+	{
+		std::stable_sort(files.begin(), files.end(), [&](size_t a, size_t b)
+		{
+			return headers[a].instanceNumber < headers[b].instanceNumber;
+		});
+	}
+}
+
+void GroupDicomSeries(std::vector<DicomSliceHeader>& headers, std::vector<DicomSeries>* series)
+{
+	series->clear();
+	std::map<std::string, size_t> seriesOf;
+	for(size_t i = 0; i < headers.size(); i++)
+	{
+		if(!headers[i].valid)
+			continue;
+		
+		auto entry = seriesOf.find(headers[i].seriesUID);
+		if(entry == seriesOf.end())
+		{
+			entry = seriesOf.insert(std::make_pair(headers[i].seriesUID, series->size())).first;
+			series->push_back(DicomSeries());
+			series->back().seriesUID = headers[i].seriesUID;
+		}
+		(*series)[entry->second].files.push_back(i);
+	}
+	
+	for(size_t s = 0; s < series->size(); s++)
+		SortSeries(headers, &(*series)[s]);
+	
+	std::stable_sort(series->begin(), series->end(), [](const DicomSeries& a, const DicomSeries& b)
+	{
+		return a.files.size() > b.files.size();
+	});
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "../Common.hpp"
+
+
+//What the sequence loader needs from the header of one file
+struct DicomSliceHeader
+{
+	bool valid;//the file parsed and has pixel data
+	uint64_t width;
+	uint64_t height;
+	uint64_t frames;
+	double pixelSpacing[2];//between rows, between columns, 0 when missing
+	double spacingBetweenSlices;
+	double sliceThickness;
+	bool hasPosition;
+	double position[3];//ImagePositionPatient
+	bool hasOrientation;
+	double orientation[6];//ImageOrientationPatient, row then column direction
+	bool hasInstanceNumber;
+	int64_t instanceNumber;
+	std::string seriesUID;//SeriesInstanceUID, empty when missing
+	uint64_t samplesPerPixel;
+	int bitsAllocated;
+	int bitsStored;
+	bool isSigned;//PixelRepresentation 1
+	double rescaleSlope;//stored value to modality value, 1 and 0 when missing
+	double rescaleIntercept;
+};
+
+//Files of one series in slice order
+struct DicomSeries
+{
+	std::string seriesUID;
+	std::vector<size_t> files;//indices into the file list
+	double sliceSpacing;//mean distance along the slice normal, 0 unless sorted by position
+};
+
+
+//Headers of all files. Every directory keeps an index of the headers it has seen, entries whose file
+//size and modification time still match are taken from there, the other files are parsed in parallel
+//and added to the index. VOLUMETRIC_RENDERER_DICOM_INDEX=0 turns the index off.
+void ReadDicomSliceHeaders(std::vector<std::string>& fileNames, std::vector<DicomSliceHeader>* headers);
+
+//Groups the valid headers by SeriesInstanceUID, largest series first. Within a series slices are sorted
+//by ImagePositionPatient projected on the slice normal, or by InstanceNumber when positions are missing,
+//or keep the order of the file list.
+void GroupDicomSeries(std::vector<DicomSliceHeader>& headers, std::vector<DicomSeries>* series);
@@ -2,8 +2,15 @@
 #include <dcmtk/dcmdata/dctk.h>
 #include <dcmtk/dcmimage/diregist.h>
 #include <dcmtk/dcmimgle/dcmimage.h>
+#include <dcmtk/dcmimgle/dipixel.h>
 
 #include "Image3DFromDicomFile.hpp"
+#include "DicomSeries.hpp"
+
+#include "../Parallel.hpp"
+#include "../Processing/Rescale.hpp"
+
+#include <atomic>
 
 
 
@@ -42,6 +49,97 @@ bool Image3DFromDicomFile(Image3D* image, std::string fileName)
 	return true;
 }
 
+//Modality values the stored values of a file can map to
+static void DicomModalityRange(DicomSliceHeader& header, double* lo, double* hi)
+{
+	double storedLo = header.isSigned ? -ldexp(1.0, header.bitsStored - 1) : 0;
+	double storedHi = header.isSigned ? ldexp(1.0, header.bitsStored - 1) - 1 : ldexp(1.0, header.bitsStored) - 1;
+	double a = storedLo * header.rescaleSlope + header.rescaleIntercept;
+	double b = storedHi * header.rescaleSlope + header.rescaleIntercept;
+	*lo = std::min(a, b);
+	*hi = std::max(a, b);
+}
+
+//First frame of one file as 16 bit values, modality value v is stored as (v - offset) * scale. Plain
+//stored values are rescaled here, compressed pixel data goes through DicomImage, whose intermediate
+//data is the modality output already.
+static bool DecodeDicomSlice(std::string fileName, DicomSliceHeader& header, double offset, double scale, uint16_t* out)
+{
+	uint64_t count = header.width * header.height;
+	
+	DcmFileFormat file;
+	if(file.loadFile(fileName.c_str()).good())
+	{
+		DcmDataset* dataset = file.getDataset();
+		float slope = header.rescaleSlope * scale;
+		float intercept = (header.rescaleIntercept - offset) * scale;
+		unsigned long length = 0;
+		if(header.bitsAllocated == 16)
+		{
+			const Uint16* stored = NULL;
+			if(dataset->findAndGetUint16Array(DCM_PixelData, stored, &length).good() && stored != NULL && length >= count)
+			{
+				RescaleStoredValues(stored, count, header.bitsStored, header.isSigned, slope, intercept, out);
+				return true;
+			}
+		}
+		else if(header.bitsAllocated == 8)
+		{
+			const Uint8* stored = NULL;
+			if(dataset->findAndGetUint8Array(DCM_PixelData, stored, &length).good() && stored != NULL && length >= count)
+			{
+				RescaleStoredValues(stored, count, header.bitsStored, header.isSigned, slope, intercept, out);
+				return true;
+			}
+		}
+	}
+	
+	DicomImage img(fileName.c_str());
+	const DiPixel* pixels = img.getStatus() == EIS_Normal ? img.getInterData() : NULL;
+	if(pixels == NULL || pixels->getCount() < count)
+		return false;
+	
+	float intercept = -offset * scale;
+	switch(pixels->getRepresentation())
+	{
+		case EPR_Uint8:
+			RescaleStoredValues((const uint8_t*)pixels->getData(), count, 8, false, scale, intercept, out);
+			return true;
+		case EPR_Sint8:
+			RescaleStoredValues((const uint8_t*)pixels->getData(), count, 8, true, scale, intercept, out);
+			return true;
+		case EPR_Uint16:
+			RescaleStoredValues((const uint16_t*)pixels->getData(), count, 16, false, scale, intercept, out);
+			return true;
+		case EPR_Sint16:
+			RescaleStoredValues((const uint16_t*)pixels->getData(), count, 16, true, scale, intercept, out);
+			return true;
+		case EPR_Sint32:
+			RescaleStoredValues((const int32_t*)pixels->getData(), count, scale, intercept, out);
+			return true;
+		default:
+			return false;
+	}
+}
+
+//PixelSpacing of the first file and the distance between slices along their normal, with
+//SpacingBetweenSlices and then SliceThickness as fallbacks. Whatever is missing stays 1.
+static void DicomSequenceSpacing(DicomSliceHeader& first, double sliceSpacing, double* spacingX, double* spacingY, double* spacingZ)
+{
+	//row spacing (between rows, so y) comes first
+	*spacingX = first.pixelSpacing[1] > 0 ? first.pixelSpacing[1] : 1;
+	*spacingY = first.pixelSpacing[0] > 0 ? first.pixelSpacing[0] : 1;
+	*spacingZ = 1;
+	
+	//slices can overlap or leave gaps, their positions say how far apart they really are
+	if(sliceSpacing > 0)
+		*spacingZ = sliceSpacing;
+	else if(first.spacingBetweenSlices > 0)
+		*spacingZ = first.spacingBetweenSlices;
+	else if(first.sliceThickness > 0)
+		*spacingZ = first.sliceThickness;
+}
+
 bool Image3DFromDicomFileSequence(Image3D* image, std::vector<std::string> fileNames)
 {
 	/* make sure data dictionary is loaded */
@@ -52,89 +150,120 @@ bool Image3DFromDicomFileSequence(Image3D* image, std::vector<std::string> fileN
 	
 	if(fileNames.size() == 0)
 		return false; 
-	//Doo check to see if all slices are same width and height and have some frame data
+	
+	//one header pass over all files, every file is parsed once and without its pixel data
+	auto start = std::chrono::high_resolution_clock::now();
 	std::cout << "Image3DFromDicomFileSequence: checking sequence for uniformality" << std::endl; 
-	bool firstPass = true; 
-	uint64_t width;
-	uint64_t height; 
-	for(int i = 0; i < fileNames.size(); i++)
+	std::vector<DicomSliceHeader> allHeaders;
+	ReadDicomSliceHeaders(fileNames, &allHeaders);
+	
+	//the largest series is loaded, in slice order
+	std::vector<DicomSeries> series;
+	GroupDicomSeries(allHeaders, &series);
+	if(series.empty())
+	{
+		std::cerr << "Image3DFromDicomFileSequence:no readable header or pixel data in the selected files" << std::endl; 
+		return false; 
+	}
+	for(size_t s = 1; s < series.size(); s++)
+		std::cout << "Image3DFromDicomFileSequence: skipping series " << series[s].seriesUID << " (" << series[s].files.size() << " files)" << std::endl; 
+	uint64_t unreadable = fileNames.size();
+	for(size_t s = 0; s < series.size(); s++)
+		unreadable -= series[s].files.size();
+	if(unreadable > 0)
+		std::cout << "Image3DFromDicomFileSequence: skipping " << unreadable << " files without a readable header or pixel data" << std::endl; 
+	
+	std::vector<std::string> seriesFiles;
+	std::vector<DicomSliceHeader> headers;
+	for(size_t i : series[0].files)
+	{
+		seriesFiles.push_back(fileNames[i]);
+		headers.push_back(allHeaders[i]);
+	}
+	fileNames.swap(seriesFiles);
+	std::cout << "Image3DFromDicomFileSequence: series " << series[0].seriesUID << " with " << fileNames.size() << " slices" << std::endl; 
+	
+	uint64_t width = headers[0].width;
+	uint64_t height = headers[0].height;
+	if(width == 0 || height == 0)
+	{	
+		std::cerr << "Image3DFromDicomFileSequence:width or hieght of image zero:" << fileNames[0] << std::endl; 		
+		return false; 
+	}
+	for(size_t i = 0; i < headers.size(); i++)
 	{
-		if(firstPass)
+		if(headers[i].samplesPerPixel != 1 || (headers[i].bitsAllocated != 8 && headers[i].bitsAllocated != 16))
 		{
-			DicomImage* img = new DicomImage(fileNames[i].c_str());
-			uint64_t W = img->getWidth();
-			uint64_t H = img->getHeight();
-			uint64_t D = img->getNumberOfFrames();
-			delete img;
-			
-			if(D < 1)
-			{
-				std::cerr << "Image3DFromDicomFileSequence:Number of frames in dicom image zero:" << fileNames[i] << std::endl; 
-				return false; 
-			}
-			
-			width = W;
-			height = H;
-			
-			if(width == 0 || height == 0)
-			{	
-				std::cerr << "Image3DFromDicomFileSequence:width or hieght of image zero:" << fileNames[i] << std::endl; 		
-				return false; 
-			}
-			
-			firstPass = false; 	
+			std::cerr << "Image3DFromDicomFileSequence:only 8 and 16 bit monochrome images are supported:" << fileNames[i] << std::endl; 
+			return false; 
 		}
-		else
+		if(headers[i].frames < 1)
 		{
-			DicomImage* img = new DicomImage(fileNames[i].c_str());
-			uint64_t W = img->getWidth();
-			uint64_t H = img->getHeight();
-			uint64_t D = img->getNumberOfFrames();
-			delete img;
-			
-			if(D < 1)
-			{
-				std::cerr << "Image3DFromDicomFileSequence:Number of frames in dicom image zero:" << fileNames[i] << std::endl; 
-				return false; 
-			}
-			
-			if(W != width) 
-			{
-				std::cerr << "Image3DFromDicomFileSequence:width varies:" << fileNames[i] << std::endl; 
-				return false;
-			}
-			if(H != height) 
-			{
-				std::cerr << "Image3DFromDicomFileSequence:height varies:" << fileNames[i] << std::endl; 
-				return false; 
-			}
+			std::cerr << "Image3DFromDicomFileSequence:Number of frames in dicom image zero:" << fileNames[i] << std::endl; 
+			return false; 
+		}
+		if(headers[i].width != width) 
+		{
+			std::cerr << "Image3DFromDicomFileSequence:width varies:" << fileNames[i] << std::endl; 
+			return false;
+		}
+		if(headers[i].height != height) 
+		{
+			std::cerr << "Image3DFromDicomFileSequence:height varies:" << fileNames[i] << std::endl; 
+			return false; 
 		}
-		
 	}
+	std::cout << "Image3DFromDicomFileSequence: read " << headers.size() << " headers in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << "s" << std::endl; 
 	
 	//Alocate Image
 	std::cout << "Image3DFromDicomFileSequence: Allocating image memory " << width << " " << height << " " << fileNames.size() << std::endl; 
-	image->Allocate(width, height, fileNames.size(), 4);
+	image->Allocate(width, height, fileNames.size(), PIXEL_TYPE_UINT16);
+	
+	//one offset and scale for the whole sequence, so equal modality values (Hounsfield units on CT) get
+	//equal voxel values. The range only gets compressed when it does not fit 16 bits.
+	double lo;
+	double hi;
+	DicomModalityRange(headers[0], &lo, &hi);
+	for(size_t i = 1; i < headers.size(); i++)
+	{
+		double fileLo;
+		double fileHi;
+		DicomModalityRange(headers[i], &fileLo, &fileHi);
+		lo = std::min(lo, fileLo);
+		hi = std::max(hi, fileHi);
+	}
+	double scale = hi - lo > 65535 ? 65535 / (hi - lo) : 1;
+	std::cout << "Image3DFromDicomFileSequence: modality values " << lo << " to " << hi << " stored from 0 with scale " << scale << std::endl; 
+	
+	double spacingX;
+	double spacingY;
+	double spacingZ;
+	DicomSequenceSpacing(headers[0], series[0].sliceSpacing, &spacingX, &spacingY, &spacingZ);
+	image->SetSpacing(spacingX, spacingY, spacingZ);
+	std::cout << "Image3DFromDicomFileSequence: voxel spacing " << spacingX << " x " << spacingY << " x " << spacingZ << std::endl; 
 
-	//Load each frame 
+	//every worker decodes its own files straight into their slices, the first failure is reported
+	start = std::chrono::high_resolution_clock::now();
 	std::cout << "Image3DFromDicomFileSequence: copying image data to 3d image" << std::endl; 
-	for(int i = 0; i < fileNames.size(); i++)
+	std::atomic<uint64_t> failed(fileNames.size());
+	ParallelFor(0, fileNames.size(), [&](uint64_t begin, uint64_t end)
 	{
-		DicomImage* img = new DicomImage(fileNames[i].c_str());
-		
-		unsigned char* imageData = (unsigned char*)image->Data() + width * height * 4 * i; 
-		
-		int status = img->getOutputData(imageData, width * height * 4, 32); 
-		if(!status)
+		for(uint64_t i = begin; i < end && failed == fileNames.size(); i++)
 		{
-			std::cout << "Image3DFromDicomFileSequence:getOutputData failed with status" <<  status << std::endl; 
-			return false; 
-		} 
-		
-		std::cout << "Image3DFromDicomFileSequence:getOutputData status code:"  << status << std::endl; 
-		
-		delete img;
+			uint16_t* imageData = (uint16_t*)image->View().Slice(i).Data();
+			uint64_t none = fileNames.size();
+			if(!DecodeDicomSlice(fileNames[i], headers[i], lo, scale, imageData))
+				failed.compare_exchange_strong(none, i);
+		}
+	});
+	
+	if(failed != fileNames.size())
+	{
+		std::cout << "Image3DFromDicomFileSequence:could not decode " << fileNames[failed] << std::endl; 
+		image->Deallocate();
+		return false; 
 	}
+	std::cout << "Image3DFromDicomFileSequence: decoded " << fileNames.size() << " slices in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << "s" << std::endl; 
 	
 	return true; 
-}
\ No newline at end of file
+}
@@ -1,5 +1,9 @@
 #include "Image3DFromNRRDFile.hpp"
 
+
+#include "../Parallel.hpp"
+
+#include <cstring>
 #include <teem/nrrd.h>
 
 
@@ -20,12 +24,10 @@ bool Image3DFromNRRDFile(Image3D* image, std::string fileName)
 		return false;
 	}
 	
-	//allocate image3d	
-	uint64_t width = 0;
-	uint64_t height = 0;
-	uint64_t depth = 0;
-	
-	
+	//allocate image3d, missing axes are one voxel thick
+	uint64_t width = 1;
+	uint64_t height = 1;
+	uint64_t depth = 1;
 	
 	if(nin->dim > 0)
 		width = nin->axis[0].size;
@@ -33,76 +35,45 @@ bool Image3DFromNRRDFile(Image3D* image, std::string fileName)
 		height = nin->axis[1].size;
 	if(nin->dim > 2)
 		depth = nin->axis[2].size;
-	
-	//find nearest power of 2 ceiling 
-	uint64_t widthP2 = pow(2, ceil(log(width)/log(2)));
-	uint64_t heightP2 = pow(2, ceil(log(height)/log(2)));
-	uint64_t depthP2 = pow(2, ceil(log(depth)/log(2)));
+	uint64_t count = width * height * depth;
 	
 	std::cout << "Image3DFromNRRDFile: Loading image of size: " << width << " x " << height << " x " << depth << std::endl; 
 	
-	//load nrrd data into image3d
+	//load nrrd data into image3d at its own size, every voxel is written so nothing needs clearing
 	if(nin->type == nrrdTypeChar || nin->type == nrrdTypeUChar)
 	{
 		std::cout << "Image3DFromNRRDFile: Data type is Char/uChar" << std::endl; 
 		image->Allocate(width, height, depth, 2);
 		uint16_t* imdata = (uint16_t*)image->Data(); 
-		for(uint64_t i = 0; i < width * height * depth; i++)
+		uint8_t* indata = (uint8_t*)nin->data;
+		ParallelFor(0, count, [&](uint64_t begin, uint64_t end)
 		{
-			imdata[i] = ((uint8_t*)(nin->data))[i] << 8; 
-		}
+			for(uint64_t i = begin; i < end; i++)
+				imdata[i] = indata[i] << 8; 
+		});
 	}
 	else if(nin->type == nrrdTypeUShort)
 	{
 		std::cout << "Image3DFromNRRDFile: Data type is UShort" << std::endl;
-		image->Allocate(widthP2, heightP2, depthP2, 2);
+		image->Allocate(width, height, depth, 2);
 		uint16_t* imdata = (uint16_t*)image->Data();
-		uint64_t inx = 0; 
-		for(uint64_t i = 0; i < widthP2 * heightP2 * depthP2; i++)
+		uint16_t* indata = (uint16_t*)nin->data;
+		ParallelFor(0, count, [&](uint64_t begin, uint64_t end)
 		{
-			imdata[i] = 0;
-		}
-		for(uint64_t k = 0; k < depth; k++)
-		{
-			for(uint64_t j = 0; j < height; j++)
-			{
-				
-				for(uint64_t i = 0; i < width; i++)
-				{
-					uint16_t val = ((uint16_t*)(nin->data))[inx]; 
-					imdata[k * widthP2 * heightP2 + j * widthP2 + i] = val;
-					inx++;
-				}
-			}
-		}
-		
+			memcpy(imdata + begin, indata + begin, (end - begin) * sizeof(uint16_t));
+		});
 	}
 	else if(nin->type == nrrdTypeShort)
 	{
 		std::cout << "Image3DFromNRRDFile: Data type is Short" << std::endl;
-		image->Allocate(widthP2, heightP2, depthP2, 2);
-		int16_t* imdata = (int16_t*)image->Data();
-		uint64_t inx = 0; 
-		uint64_t offSetW = (widthP2 - width ) / 2;
-		uint64_t offSetH = (heightP2 - height ) / 2;
-		uint64_t offSetD = (depthP2 - depth ) / 2;
-		for(uint64_t i = 0; i < widthP2 * heightP2 * depthP2; i++)
-		{
-			imdata[i] = 0;
-		}
-		for(uint64_t k = 0; k < depth; k++)
+		image->Allocate(width, height, depth, 2);
+		uint16_t* imdata = (uint16_t*)image->Data();
+		int16_t* indata = (int16_t*)nin->data;
+		ParallelFor(0, count, [&](uint64_t begin, uint64_t end)
 		{
-			for(uint64_t j = 0; j < height; j++)
-			{
-				for(uint64_t i = 0; i < width; i++)
-				{
-					uint16_t val = (32767 + (int)((int16_t*)(nin->data))[inx]) / 2;
-					imdata[k * widthP2 * heightP2 + j * widthP2 + i] = val;
-					inx++;
-				}
-			}
-		}
-			
+			for(uint64_t i = begin; i < end; i++)
+				imdata[i] = (32767 + (int)indata[i]) / 2;
+		});
 	}
 	else
 	{
@@ -112,6 +83,25 @@ bool Image3DFromNRRDFile(Image3D* image, std::string fileName)
 		return false; 
 	}
 	
+	//axis spacing, or the length of the axis' space direction for files that give an orientation instead
+	double spacing[3] = {1, 1, 1};
+	for(unsigned int a = 0; a < nin->dim && a < 3; a++)
+	{
+		double s = 0;
+		if(AIR_EXISTS(nin->axis[a].spacing))
+			s = fabs(nin->axis[a].spacing);
+		else if(nin->spaceDim > 0 && AIR_EXISTS(nin->axis[a].spaceDirection[0]))
+		{
+			for(unsigned int d = 0; d < nin->spaceDim; d++)
+				s += nin->axis[a].spaceDirection[d] * nin->axis[a].spaceDirection[d];
+			s = sqrt(s);
+		}
+		if(s > 0)
+			spacing[a] = s;
+	}
+	image->SetSpacing(spacing[0], spacing[1], spacing[2]);
+	std::cout << "Image3DFromNRRDFile: Voxel spacing " << spacing[0] << " x " << spacing[1] << " x " << spacing[2] << std::endl; 
+	
 	std::cout << "Image3DFromNRRDFile: Cleanup " << std::endl; 
 	
 	//delete nrrd 
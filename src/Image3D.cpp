@@ -1,36 +1,187 @@
 #include "Image3D.hpp"
 
+
+#include "Parallel.hpp"
+#include "BufferPool.hpp"
+#include "Processing/NeighbourhoodFilters.hpp"
+#include "Processing/SlidingMedian.hpp"
+#include "Processing/Morphology.hpp"
+#include "Processing/Resample.hpp"
+#include "Processing/LookupTable.hpp"
+#include "Processing/MinMax.hpp"
+
+#include <limits>
+#include <cstring>
+#include <mutex>
+#include <stdlib.h>
+
+
 Image3D::Image3D()
 {
 	width = 0;
 	height = 0; 
 	depth = 0;
 	pixelSize = 0;
+	pixelType = PIXEL_TYPE_RAW;
+	data = NULL;
+	spacingX = 1;
+	spacingY = 1;
+	spacingZ = 1;
+	InvalidateStatistics();
 }
 
-Image3D::Image3D(uint64_t W, uint64_t H, uint64_t D, uint64_t P)
+Image3D::Image3D(uint64_t W, uint64_t H, uint64_t D, uint64_t P) : Image3D()
 {
 	Allocate(W, H, D, P);
 }
 
+Image3D::Image3D(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type) : Image3D()
+{
+	Allocate(W, H, D, type);
+}
+
 Image3D::~Image3D()
 {
 	Deallocate();
 }
 
+Image3D::Image3D(Image3D&& other) : Image3D()
+{
+	Swap(other);
+}
+
+Image3D& Image3D::operator=(Image3D&& other)
+{
+	if(this != &other)
+	{
+		Deallocate();
+		Swap(other);
+	}
+	return *this;
+}
+
+static std::mutex backingStoreMutex;
+static bool backingStoreSet = false;
+static std::string backingStoreDirectory;
+static uint64_t backingStoreMinBytes = 0;
+
+void Image3D::SetBackingStore(std::string directory, uint64_t minBytes)
+{
+	std::lock_guard<std::mutex> lock(backingStoreMutex);
+	backingStoreSet = true;
+	backingStoreDirectory = directory;
+	backingStoreMinBytes = minBytes;
+}
+
+//directory the image should be mapped from, empty if it belongs in RAM
+static std::string BackingStoreFor(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(backingStoreMutex);
+	
+	//first use, pick up the settings from the environment
+	if(!backingStoreSet)
+	{
+		const char* dir = getenv("VOLUMETRIC_RENDERER_SWAP_DIR");
+		const char* minMB = getenv("VOLUMETRIC_RENDERER_SWAP_MIN_MB");
+		backingStoreDirectory = dir != NULL ? dir : "";
+		backingStoreMinBytes = (minMB != NULL ? atoll(minMB) : 256) << 20;
+		backingStoreSet = true;
+	}
+	
+	if(backingStoreDirectory.empty() || bytes < backingStoreMinBytes)
+		return "";
+	return backingStoreDirectory;
+}
+
 void Image3D::Allocate(uint64_t W, uint64_t H, uint64_t D, uint64_t P)
 {
+	Deallocate();
+	
 	width = W;
 	height = H; 
 	depth = D;
 	pixelSize = P; 
-	data = new unsigned char[W * H * D * P];
+	SetSpacing(1, 1, 1);
+	
+	//large images go to the backing store when one is set, RAM is the fallback if mapping fails
+	std::string directory = BackingStoreFor(ByteSize());
+	if(!directory.empty() && mappedData.Allocate(ByteSize(), directory))
+	{
+		data = mappedData.Data();
+		mappedData.Advise(0, ByteSize(), MAPPED_ADVICE_SEQUENTIAL);
+	}
+	else
+		data = BufferPool::Acquire(ByteSize());
+	
+	//single byte and two byte images have always been unsigned monochrome
+	if(P == 1)
+		pixelType = PIXEL_TYPE_UINT8;
+	else if(P == 2)
+		pixelType = PIXEL_TYPE_UINT16;
+	else
+		pixelType = PIXEL_TYPE_RAW;
+	
+	InvalidateStatistics();
+}
+
+void Image3D::Allocate(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type)
+{
+	Allocate(W, H, D, PixelTypeSize(type));
+	pixelType = type;
 }
 
 void Image3D::Deallocate()
 {
-	if(width > 0 && height > 0 && depth > 0 && pixelSize > 0)
-		delete[] (unsigned char*)data; 
+	if(mappedData.Data() != NULL)
+		mappedData.Deallocate();
+	else if(data != NULL)
+		BufferPool::Release(data, ByteSize());
+	
+	width = 0;
+	height = 0; 
+	depth = 0;
+	pixelSize = 0;
+	pixelType = PIXEL_TYPE_RAW;
+	data = NULL;
+	InvalidateStatistics();
+}
+
+bool Image3D::IsMapped()
+{
+	return mappedData.Data() != NULL;
+}
+
+void Image3D::Advise(MAPPED_ADVICE advice, uint64_t zBegin, uint64_t zEnd)
+{
+	uint64_t sliceBytes = width * height * pixelSize;
+	if(IsMapped() && zEnd > zBegin)
+		mappedData.Advise(zBegin * sliceBytes, (zEnd - zBegin) * sliceBytes, advice);
+}
+
+Image3DView Image3D::View()
+{
+	Image3DView view(data, width, height, depth, pixelSize, pixelType, width, width * height);
+	view.SetSpacing(spacingX, spacingY, spacingZ);
+	return view;
+}
+
+void Image3D::Swap(Image3D& other)
+{
+	std::swap(width, other.width);
+	std::swap(height, other.height);
+	std::swap(depth, other.depth);
+	std::swap(pixelSize, other.pixelSize);
+	std::swap(pixelType, other.pixelType);
+	std::swap(data, other.data);
+	mappedData.Swap(other.mappedData);
+	std::swap(spacingX, other.spacingX);
+	std::swap(spacingY, other.spacingY);
+	std::swap(spacingZ, other.spacingZ);
+	std::swap(cachedMinMaxValid, other.cachedMinMaxValid);
+	std::swap(cachedMin, other.cachedMin);
+	std::swap(cachedMax, other.cachedMax);
+	std::swap(cachedHistogramValid, other.cachedHistogramValid);
+	cachedHistogram.swap(other.cachedHistogram);
 }
 
 void* Image3D::Data()
@@ -53,73 +204,416 @@ uint64_t Image3D::Depth()
 	return depth; 
 }
 
+PIXEL_TYPE Image3D::Type()
+{
+	return pixelType; 
+}
+
+uint64_t Image3D::PixelSize()
+{
+	return pixelSize; 
+}
+
 uint64_t Image3D::ByteSize()
 {
 	return width * height * depth * pixelSize; 
 }
 
+void Image3D::SetSpacing(double x, double y, double z)
+{
+	spacingX = x;
+	spacingY = y;
+	spacingZ = z;
+}
+
+double Image3D::SpacingX()
+{
+	return spacingX;
+}
+
+double Image3D::SpacingY()
+{
+	return spacingY;
+}
+
+double Image3D::SpacingZ()
+{
+	return spacingZ;
+}
+
 void Image3D::Copy(Image3D& inImg)
 {
-	unsigned char* indata = (unsigned char*)inImg.Data();
-	for(uint64_t z = 0; z < depth; z++)
+	memcpy(data, inImg.data, std::min(ByteSize(), inImg.ByteSize()));
+	SetSpacing(inImg.spacingX, inImg.spacingY, inImg.spacingZ);
+	
+	//an exact copy has the same statistics
+	InvalidateStatistics();
+	if(ByteSize() == inImg.ByteSize() && pixelType == inImg.pixelType)
 	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				for(uint64_t c = 0; c < pixelSize; c++)
-				{
-					((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + c] = 
-									indata[(z * width * height + y * width + x) * pixelSize + c];
-				}
-			}
-		}
+		cachedMinMaxValid = inImg.cachedMinMaxValid;
+		cachedMin = inImg.cachedMin;
+		cachedMax = inImg.cachedMax;
+		cachedHistogramValid = inImg.cachedHistogramValid;
+		cachedHistogram = inImg.cachedHistogram;
 	}
 }
 
-void Image3D::Smooth2D()
+void Image3D::Assign(Image3DView inView)
 {
-	if(pixelSize == 1)//8 bit monochrome images
+	//a view of this image has to stay readable until the copy is done
+	Image3D outImg(inView.Width(), inView.Height(), inView.Depth(), inView.PixelSize());
+	outImg.pixelType = inView.Type();
+	outImg.SetSpacing(inView.SpacingX(), inView.SpacingY(), inView.SpacingZ());
+	
+	uint64_t rowBytes = inView.Width() * inView.PixelSize();
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 	{
-	for(uint64_t z = 0; z < depth; z++)
+		if(inView.IsContiguous())
+			memcpy(outImg.View().Row(0, zBegin), inView.Row(0, zBegin), (zEnd - zBegin) * inView.Height() * rowBytes);
+		else
+			for(uint64_t z = zBegin; z < zEnd; z++)
+				for(uint64_t y = 0; y < inView.Height(); y++)
+					memcpy(outImg.View().Row(y, z), inView.Row(y, z), rowBytes);
+	});
+	Swap(outImg);
+}
+
+//Output of a filter that reads inView, same size, type and spacing
+static void AllocateFilterOutput(Image3DView& inView, Image3D* outImg)
+{
+	outImg->Allocate(inView.Width(), inView.Height(), inView.Depth(), inView.Type());
+	outImg->SetSpacing(inView.SpacingX(), inView.SpacingY(), inView.SpacingZ());
+}
+
+//
+//Neighbourhood filters. The kernels in Processing/NeighbourhoodFilters.hpp are templated on the voxel
+//type and the boundary policy, RunKernel picks the instantiation that matches the image at runtime.
+//
+
+template<template<class, class> class Kernel, class T> static void RunKernel(Image3DView& inView, Image3D& outImg, BOUNDARY_MODE mode)
+{
+	TypedImage3D<T> in = inView.Typed<T>();
+	TypedImage3D<T> out = outImg.Typed<T>();
+	
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				
-				
-				int running = 0; 
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-					
-								
-				
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x1) * pixelSize];
-				
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = running / 27;
-				
-			}
-		}
+		if(mode == BOUNDARY_MIRROR)
+			Kernel<T, BoundaryMirror>::Run(in, out, zBegin, zEnd);
+		else if(mode == BOUNDARY_ZERO)
+			Kernel<T, BoundaryZero>::Run(in, out, zBegin, zEnd);
+		else
+			Kernel<T, BoundaryClamp>::Run(in, out, zBegin, zEnd);
+	});
+}
+
+template<template<class, class> class Kernel> static bool RunKernel(Image3DView& inView, Image3D& outImg, BOUNDARY_MODE mode)
+{
+	switch(inView.Type())
+	{
+		case PIXEL_TYPE_UINT8:
+			RunKernel<Kernel, uint8_t>(inView, outImg, mode);
+			return true;
+		case PIXEL_TYPE_UINT16:
+			RunKernel<Kernel, uint16_t>(inView, outImg, mode);
+			return true;
+		case PIXEL_TYPE_INT16:
+			RunKernel<Kernel, int16_t>(inView, outImg, mode);
+			return true;
+		case PIXEL_TYPE_FLOAT:
+			RunKernel<Kernel, float>(inView, outImg, mode);
+			return true;
+		default:
+			return false;
+	}
+}
+
+void Image3D::Smooth2D(BOUNDARY_MODE mode)
+{
+	Smooth2D(View(), mode);
+}
+
+void Image3D::Smooth2D(Image3DView inView, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunKernel<Smooth2DKernel>(inView, outImg, mode))
+		Swap(outImg);
+}
+
+void Image3D::Median2D(BOUNDARY_MODE mode)
+{
+	Median2D(View(), mode);
+}
+
+void Image3D::Median2D(Image3DView inView, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunKernel<Median2DKernel>(inView, outImg, mode))
+		Swap(outImg);
+}
+
+void Image3D::Smooth(BOUNDARY_MODE mode)
+{
+	Smooth(View(), mode);
+}
+
+void Image3D::Smooth(Image3DView inView, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunKernel<SmoothKernel>(inView, outImg, mode))
+		Swap(outImg);
+}
+
+void Image3D::Median(BOUNDARY_MODE mode)
+{
+	Median(View(), mode);
+}
+
+void Image3D::Median(Image3DView inView, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunKernel<MedianKernel>(inView, outImg, mode))
+		Swap(outImg);
+}
+
+//The sliding window median only exists for the integer types it can histogram
+template<class T> static void RunSlidingMedian(Image3DView& inView, Image3D& outImg, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	TypedImage3D<T> in = inView.Typed<T>();
+	TypedImage3D<T> out = outImg.Typed<T>();
+	
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
+	{
+		if(mode == BOUNDARY_MIRROR)
+			SlidingMedianKernel<T, BoundaryMirror>::Run(in, out, radius, planar, zBegin, zEnd);
+		else if(mode == BOUNDARY_ZERO)
+			SlidingMedianKernel<T, BoundaryZero>::Run(in, out, radius, planar, zBegin, zEnd);
+		else
+			SlidingMedianKernel<T, BoundaryClamp>::Run(in, out, radius, planar, zBegin, zEnd);
+	});
+}
+
+void Image3D::MedianRadius(int radius, bool planar, BOUNDARY_MODE mode)
+{
+	MedianRadius(View(), radius, planar, mode);
+}
+
+void Image3D::MedianRadius(Image3DView inView, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	if(radius < 1 || radius > 5)
+	{
+		std::cout << "Image3D: median radius must be between 1 and 5" << std::endl;
+		return;
+	}
+	
+	//other voxel types only have the 3x3(x3) sorting median
+	if(inView.Type() != PIXEL_TYPE_UINT8 && inView.Type() != PIXEL_TYPE_UINT16)
+	{
+		if(radius != 1)
+			std::cout << "Image3D: median radius above 1 needs an 8 or 16 bit image" << std::endl;
+		else if(planar)
+			Median2D(inView, mode);
+		else
+			Median(inView, mode);
+		return;
+	}
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(inView.Type() == PIXEL_TYPE_UINT8)
+		RunSlidingMedian<uint8_t>(inView, outImg, radius, planar, mode);
+	else
+		RunSlidingMedian<uint16_t>(inView, outImg, radius, planar, mode);
+	Swap(outImg);
+}
+
+//One pass per axis, each axis splits its work so the lines it filters never cross a worker boundary
+template<class T, template<class> class Op> static void RunMorphology(Image3DView& inView, Image3D& outImg, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	TypedImage3D<T> in = inView.Typed<T>();
+	TypedImage3D<T> out = outImg.Typed<T>();
+	T pad = mode == BOUNDARY_ZERO ? (T)0 : Op<T>::Identity();
+	
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
+	{
+		MorphologyPassX<T, Op<T>>(in, out, radius, pad, zBegin, zEnd);
+	});
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
+	{
+		MorphologyPassY<T, Op<T>>(out, radius, pad, zBegin, zEnd);
+	});
+	if(planar)
+		return;
+	ParallelFor(0, inView.Height(), [&](uint64_t yBegin, uint64_t yEnd)
+	{
+		MorphologyPassZ<T, Op<T>>(out, radius, pad, yBegin, yEnd);
+	});
+}
+
+template<template<class> class Op> static bool RunMorphology(Image3DView& inView, Image3D& outImg, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	switch(inView.Type())
+	{
+		case PIXEL_TYPE_UINT8:
+			RunMorphology<uint8_t, Op>(inView, outImg, radius, planar, mode);
+			return true;
+		case PIXEL_TYPE_UINT16:
+			RunMorphology<uint16_t, Op>(inView, outImg, radius, planar, mode);
+			return true;
+		case PIXEL_TYPE_INT16:
+			RunMorphology<int16_t, Op>(inView, outImg, radius, planar, mode);
+			return true;
+		case PIXEL_TYPE_FLOAT:
+			RunMorphology<float, Op>(inView, outImg, radius, planar, mode);
+			return true;
+		default:
+			return false;
+	}
+}
+
+void Image3D::Erode(int radius, bool planar, BOUNDARY_MODE mode)
+{
+	Erode(View(), radius, planar, mode);
+}
+
+void Image3D::Erode(Image3DView inView, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW || radius < 1)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunMorphology<MorphologyMin>(inView, outImg, radius, planar, mode))
+		Swap(outImg);
+}
+
+void Image3D::Dilate(int radius, bool planar, BOUNDARY_MODE mode)
+{
+	Dilate(View(), radius, planar, mode);
+}
+
+void Image3D::Dilate(Image3DView inView, int radius, bool planar, BOUNDARY_MODE mode)
+{
+	if(inView.Type() == PIXEL_TYPE_RAW || radius < 1)
+		return;
+	
+	Image3D outImg;
+	AllocateFilterOutput(inView, &outImg);
+	if(RunMorphology<MorphologyMax>(inView, outImg, radius, planar, mode))
+		Swap(outImg);
+}
+
+void Image3D::Open(int radius, bool planar, BOUNDARY_MODE mode)
+{
+	Erode(radius, planar, mode);
+	Dilate(radius, planar, mode);
+}
+
+void Image3D::Close(int radius, bool planar, BOUNDARY_MODE mode)
+{
+	Dilate(radius, planar, mode);
+	Erode(radius, planar, mode);
+}
+
+template<class T> static void ForegroundLabels(Image3D& img, std::vector<uint32_t>* labels)
+{
+	T* v = (T*)img.Data();
+	ParallelFor(0, img.Width() * img.Height() * img.Depth(), [&](uint64_t begin, uint64_t end)
+	{
+		for(uint64_t i = begin; i < end; i++)
+			(*labels)[i] = v[i] != 0 ? 1 : 0;
+	});
+}
+
+template<class T> static void KeepLabel(Image3D& img, std::vector<uint32_t>& labels, uint32_t label)
+{
+	T* v = (T*)img.Data();
+	ParallelFor(0, img.Width() * img.Height() * img.Depth(), [&](uint64_t begin, uint64_t end)
+	{
+		for(uint64_t i = begin; i < end; i++)
+			if(labels[i] != label)
+				v[i] = 0;
+	});
+}
+
+uint32_t Image3D::LabelComponents(std::vector<uint32_t>* labels, std::vector<ComponentInfo>* components, CONNECTIVITY connectivity)
+{
+	labels->resize(width * height * depth);
+	switch(pixelType)
+	{
+		case PIXEL_TYPE_UINT8:
+			ForegroundLabels<uint8_t>(*this, labels);
+			break;
+		case PIXEL_TYPE_UINT16:
+			ForegroundLabels<uint16_t>(*this, labels);
+			break;
+		case PIXEL_TYPE_INT16:
+			ForegroundLabels<int16_t>(*this, labels);
+			break;
+		case PIXEL_TYPE_FLOAT:
+			ForegroundLabels<float>(*this, labels);
+			break;
+		default:
+			std::cout << "Image3D: LabelComponents needs a scalar image" << std::endl;
+			labels->clear();
+			components->clear();
+			return 0;
 	}
+	return ::LabelComponents(labels->data(), width, height, depth, connectivity, components);
+}
+
+void Image3D::KeepLargestComponent(CONNECTIVITY connectivity)
+{
+	std::vector<uint32_t> labels;
+	std::vector<ComponentInfo> components;
+	if(LabelComponents(&labels, &components, connectivity) == 0)
+		return;
+
+	uint32_t largest = 1;
+	for(uint32_t label = 2; label <= components.size(); label++)
+		if(components[label - 1].voxels > components[largest - 1].voxels)
+			largest = label;
+
+	InvalidateStatistics();
+	switch(pixelType)
+	{
+		case PIXEL_TYPE_UINT8:
+			KeepLabel<uint8_t>(*this, labels, largest);
+			break;
+		case PIXEL_TYPE_UINT16:
+			KeepLabel<uint16_t>(*this, labels, largest);
+			break;
+		case PIXEL_TYPE_INT16:
+			KeepLabel<int16_t>(*this, labels, largest);
+			break;
+		case PIXEL_TYPE_FLOAT:
+			KeepLabel<float>(*this, labels, largest);
+			break;
+		default:
+			break;
 	}
-	else if(pixelSize == 2)//16 bit monochrome images
+}
+
+void Image3D::CentralDifference(Image3D& inImg)
+{
+	InvalidateStatistics();
+	
+	if(inImg.pixelSize == 1)//8 bit monochrome images
 	{
 	for(uint64_t z = 0; z < depth; z++)
 	{
@@ -131,40 +625,46 @@ void Image3D::Smooth2D()
 				int64_t x1 = x-1;
 				int64_t y0 = y+1;
 				int64_t y1 = y-1;
+				int64_t z0 = z+1;
+				int64_t z1 = z-1;
 				
+				unsigned char* indata = (unsigned char*)inImg.Data();
 				
-				int running = 0; 
+				int dx0;
+				int dx1;
+				int dy0;
+				int dy1;
+				int dz0;
+				int dz1; 
 				
 				if(x0 < 0 || x0 >= width) x0 = x;
 				if(x1 < 0 || x1 >= width) x1 = x;
 				if(y0 < 0 || y0 >= height) y0 = y;
 				if(y1 < 0 || y1 >= height) y1 = y;
+				if(z0 < 0 || z0 >= depth) z0 = z;
+				if(z1 < 0 || z1 >= depth) z1 = z;
 					
-								
+				dx0 = indata[(z * width * height + y * width + x0) * inImg.pixelSize];
+				dx1 = indata[(z * width * height + y * width + x1) * inImg.pixelSize];
+				dy0 = indata[(z * width * height + y0 * width + x) * inImg.pixelSize];
+				dy1 = indata[(z * width * height + y1 * width + x) * inImg.pixelSize];
+				dz0 = indata[(z0 * width * height + y * width + x) * inImg.pixelSize];
+				dz1 = indata[(z1 * width * height + y * width + x) * inImg.pixelSize];
 				
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x1)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x1)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x1)];
+				int gX = ((dx1 - dx0) + 255) / 2;
+				int gY = ((dy1 - dy0) + 255) / 2; 
+				int gZ = ((dz1 - dz0) + 255) / 2;
 				
 				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = running / 27;
+				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = gX;
+				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = gY;
+				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 2] = gZ;
 			}
 		}
-	}	
 	}
-}
-
-void Image3D::Median2D()
-{
-	if(pixelSize == 1)//8 bit monochrome images
+	}
+	if(inImg.pixelSize == 2)//16 bit monochromeimages
 	{
-	std::vector<int> vals(9); 
 	for(uint64_t z = 0; z < depth; z++)
 	{
 		for(uint64_t y = 0; y < height; y++)
@@ -175,647 +675,72 @@ void Image3D::Median2D()
 				int64_t x1 = x-1;
 				int64_t y0 = y+1;
 				int64_t y1 = y-1;
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				
-				vals[0] = ((unsigned char*)data)[(z * width * height + y0 * width + x0) * pixelSize];
-				vals[1] = ((unsigned char*)data)[(z * width * height + y0 * width + x) * pixelSize];
-				vals[2] = ((unsigned char*)data)[(z * width * height + y0 * width + x1) * pixelSize];
-				vals[3] = ((unsigned char*)data)[(z * width * height + y * width + x0) * pixelSize];
-				vals[4] = ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize];
-				vals[5] = ((unsigned char*)data)[(z * width * height + y * width + x1) * pixelSize];
-				vals[6] = ((unsigned char*)data)[(z * width * height + y1 * width + x0) * pixelSize];
-				vals[7] = ((unsigned char*)data)[(z * width * height + y1 * width + x) * pixelSize];
-				vals[8] = ((unsigned char*)data)[(z * width * height + y1 * width + x1) * pixelSize];
-				
-				std::nth_element(vals.begin(), vals.begin() + vals.size()/2, vals.end()); 
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = vals[vals.size()/2];
-				
-			}
-		}
-	}
-	}
-	if(pixelSize == 2)//16 bit monochrome images
-	{
-	std::vector<int> vals(9); 
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;				
-				
-				vals[0] = ((uint16_t*)data)[(z * width * height + y0 * width + x0) ];
-				vals[1] = ((uint16_t*)data)[(z * width * height + y0 * width + x) ];
-				vals[2] = ((uint16_t*)data)[(z * width * height + y0 * width + x1) ];
-				vals[3] = ((uint16_t*)data)[(z * width * height + y * width + x0) ];
-				vals[4] = ((uint16_t*)data)[(z * width * height + y * width + x) ];
-				vals[5] = ((uint16_t*)data)[(z * width * height + y * width + x1) ];
-				vals[6] = ((uint16_t*)data)[(z * width * height + y1 * width + x0) ];
-				vals[7] = ((uint16_t*)data)[(z * width * height + y1 * width + x) ];
-				vals[8] = ((uint16_t*)data)[(z * width * height + y1 * width + x1) ];
-				
-				std::nth_element(vals.begin(), vals.begin() + vals.size()/2, vals.end()); 
-				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = vals[vals.size()/2];
-				
-			}
-		}
-	}
-	}
-}
-
-void Image3D::Smooth()
-{
-	if(pixelSize == 1)//8 bit monochrome images
-	{
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				int running = 0; 
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-								
-				running += ((unsigned char*)data)[(z0 * width * height + y0 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y0 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y0 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y1 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y1 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z0 * width * height + y1 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y0 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z * width * height + y1 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y0 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y0 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y0 * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y * width + x1) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y1 * width + x0) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y1 * width + x) * pixelSize];
-				running += ((unsigned char*)data)[(z1 * width * height + y1 * width + x1) * pixelSize];
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = running / 27;
-			}
-		}
-	}
-	}
-	if(pixelSize == 2)//16 bit monochromeimages
-	{
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				int running = 0; 
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-								
-				running += ((uint16_t*)data)[(z0 * width * height + y0 * width + x0)];
-				running += ((uint16_t*)data)[(z0 * width * height + y0 * width + x)];
-				running += ((uint16_t*)data)[(z0 * width * height + y0 * width + x1)];
-				running += ((uint16_t*)data)[(z0 * width * height + y * width + x0)];
-				running += ((uint16_t*)data)[(z0 * width * height + y * width + x)];
-				running += ((uint16_t*)data)[(z0 * width * height + y * width + x1)];
-				running += ((uint16_t*)data)[(z0 * width * height + y1 * width + x0)];
-				running += ((uint16_t*)data)[(z0 * width * height + y1 * width + x) ];
-				running += ((uint16_t*)data)[(z0 * width * height + y1 * width + x1)];
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y0 * width + x1)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y * width + x1)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x0)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x)];
-				running += ((uint16_t*)data)[(z * width * height + y1 * width + x1)];
-				running += ((uint16_t*)data)[(z1 * width * height + y0 * width + x0)];
-				running += ((uint16_t*)data)[(z1 * width * height + y0 * width + x)];
-				running += ((uint16_t*)data)[(z1 * width * height + y0 * width + x1)];
-				running += ((uint16_t*)data)[(z1 * width * height + y * width + x0)];
-				running += ((uint16_t*)data)[(z1 * width * height + y * width + x)];
-				running += ((uint16_t*)data)[(z1 * width * height + y * width + x1)];
-				running += ((uint16_t*)data)[(z1 * width * height + y1 * width + x0) ];
-				running += ((uint16_t*)data)[(z1 * width * height + y1 * width + x)];
-				running += ((uint16_t*)data)[(z1 * width * height + y1 * width + x1)];
-				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = running / 27;
-			}
-		}
-	}
-	}
-}
-
-void Image3D::Median()
-{
-	if(pixelSize == 1)//8 bit monochrome images
-	{
-	std::vector<int> vals(27); 
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-								
-				vals[0] = ((unsigned char*)data)[(z0 * width * height + y0 * width + x0) * pixelSize];
-				vals[1] = ((unsigned char*)data)[(z0 * width * height + y0 * width + x) * pixelSize];
-				vals[2] = ((unsigned char*)data)[(z0 * width * height + y0 * width + x1) * pixelSize];
-				vals[3] = ((unsigned char*)data)[(z0 * width * height + y * width + x0) * pixelSize];
-				vals[4] = ((unsigned char*)data)[(z0 * width * height + y * width + x) * pixelSize];
-				vals[5] = ((unsigned char*)data)[(z0 * width * height + y * width + x1) * pixelSize];
-				vals[6] = ((unsigned char*)data)[(z0 * width * height + y1 * width + x0) * pixelSize];
-				vals[7] = ((unsigned char*)data)[(z0 * width * height + y1 * width + x) * pixelSize];
-				vals[8] = ((unsigned char*)data)[(z0 * width * height + y1 * width + x1) * pixelSize];
-				vals[9] = ((unsigned char*)data)[(z * width * height + y0 * width + x0) * pixelSize];
-				vals[10] = ((unsigned char*)data)[(z * width * height + y0 * width + x) * pixelSize];
-				vals[11] = ((unsigned char*)data)[(z * width * height + y0 * width + x1) * pixelSize];
-				vals[12] = ((unsigned char*)data)[(z * width * height + y * width + x0) * pixelSize];
-				vals[13] = ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize];
-				vals[14] = ((unsigned char*)data)[(z * width * height + y * width + x1) * pixelSize];
-				vals[15] = ((unsigned char*)data)[(z * width * height + y1 * width + x0) * pixelSize];
-				vals[16] = ((unsigned char*)data)[(z * width * height + y1 * width + x) * pixelSize];
-				vals[17] = ((unsigned char*)data)[(z * width * height + y1 * width + x1) * pixelSize];
-				vals[18] = ((unsigned char*)data)[(z1 * width * height + y0 * width + x0) * pixelSize];
-				vals[19] = ((unsigned char*)data)[(z1 * width * height + y0 * width + x) * pixelSize];
-				vals[20] = ((unsigned char*)data)[(z1 * width * height + y0 * width + x1) * pixelSize];
-				vals[21] = ((unsigned char*)data)[(z1 * width * height + y * width + x0) * pixelSize];
-				vals[22] = ((unsigned char*)data)[(z1 * width * height + y * width + x) * pixelSize];
-				vals[23] = ((unsigned char*)data)[(z1 * width * height + y * width + x1) * pixelSize];
-				vals[24] = ((unsigned char*)data)[(z1 * width * height + y1 * width + x0) * pixelSize];
-				vals[25] = ((unsigned char*)data)[(z1 * width * height + y1 * width + x) * pixelSize];
-				vals[26] = ((unsigned char*)data)[(z1 * width * height + y1 * width + x1) * pixelSize];
-				
-				
-				std::nth_element(vals.begin(), vals.begin() + vals.size()/2, vals.end()); 
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = vals[vals.size()/2];
-			}
-		}
-	}
-	}
-	if(pixelSize == 2)//16 bit monochromeimages
-	{
-	std::vector<int> vals(27); 
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-								
-				vals[0] = ((uint16_t*)data)[(z0 * width * height + y0 * width + x0)];
-				vals[1] = ((uint16_t*)data)[(z0 * width * height + y0 * width + x) ];
-				vals[2] = ((uint16_t*)data)[(z0 * width * height + y0 * width + x1) ];
-				vals[3] = ((uint16_t*)data)[(z0 * width * height + y * width + x0) ];
-				vals[4] = ((uint16_t*)data)[(z0 * width * height + y * width + x) ];
-				vals[5] = ((uint16_t*)data)[(z0 * width * height + y * width + x1) ];
-				vals[6] = ((uint16_t*)data)[(z0 * width * height + y1 * width + x0) ];
-				vals[7] = ((uint16_t*)data)[(z0 * width * height + y1 * width + x) ];
-				vals[8] = ((uint16_t*)data)[(z0 * width * height + y1 * width + x1) ];
-				vals[9] = ((uint16_t*)data)[(z * width * height + y0 * width + x0) ];
-				vals[10] = ((uint16_t*)data)[(z * width * height + y0 * width + x) ];
-				vals[11] = ((uint16_t*)data)[(z * width * height + y0 * width + x1) ];
-				vals[12] = ((uint16_t*)data)[(z * width * height + y * width + x0) ];
-				vals[13] = ((uint16_t*)data)[(z * width * height + y * width + x) ];
-				vals[14] = ((uint16_t*)data)[(z * width * height + y * width + x1) ];
-				vals[15] = ((uint16_t*)data)[(z * width * height + y1 * width + x0) ];
-				vals[16] = ((uint16_t*)data)[(z * width * height + y1 * width + x) ];
-				vals[17] = ((uint16_t*)data)[(z * width * height + y1 * width + x1) ];
-				vals[18] = ((uint16_t*)data)[(z1 * width * height + y0 * width + x0) ];
-				vals[19] = ((uint16_t*)data)[(z1 * width * height + y0 * width + x) ];
-				vals[20] = ((uint16_t*)data)[(z1 * width * height + y0 * width + x1) ];
-				vals[21] = ((uint16_t*)data)[(z1 * width * height + y * width + x0) ];
-				vals[22] = ((uint16_t*)data)[(z1 * width * height + y * width + x) ];
-				vals[23] = ((uint16_t*)data)[(z1 * width * height + y * width + x1) ];
-				vals[24] = ((uint16_t*)data)[(z1 * width * height + y1 * width + x0) ];
-				vals[25] = ((uint16_t*)data)[(z1 * width * height + y1 * width + x) ];
-				vals[26] = ((uint16_t*)data)[(z1 * width * height + y1 * width + x1) ];
-				
-				
-				std::nth_element(vals.begin(), vals.begin() + vals.size()/2, vals.end()); 
-				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = vals[vals.size()/2];
-			}
-		}
-	}
-	}
-}
-
-void Image3D::CentralDifference(Image3D& inImg)
-{
-	if(inImg.pixelSize == 1)//8 bit monochrome images
-	{
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				unsigned char* indata = (unsigned char*)inImg.Data();
-				
-				int dx0;
-				int dx1;
-				int dy0;
-				int dy1;
-				int dz0;
-				int dz1; 
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-				dx0 = indata[(z * width * height + y * width + x0) * inImg.pixelSize];
-				dx1 = indata[(z * width * height + y * width + x1) * inImg.pixelSize];
-				dy0 = indata[(z * width * height + y0 * width + x) * inImg.pixelSize];
-				dy1 = indata[(z * width * height + y1 * width + x) * inImg.pixelSize];
-				dz0 = indata[(z0 * width * height + y * width + x) * inImg.pixelSize];
-				dz1 = indata[(z1 * width * height + y * width + x) * inImg.pixelSize];
-				
-				int gX = ((dx1 - dx0) + 255) / 2;
-				int gY = ((dy1 - dy0) + 255) / 2; 
-				int gZ = ((dz1 - dz0) + 255) / 2;
-				
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = gX;
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = gY;
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 2] = gZ;
-			}
-		}
-	}
-	}
-	if(inImg.pixelSize == 2)//16 bit monochromeimages
-	{
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				uint16_t* indata = (uint16_t*)inImg.Data();
-				
-				int dx0;
-				int dx1;
-				int dy0;
-				int dy1;
-				int dz0;
-				int dz1; 
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-				dx0 = indata[(z * width * height + y * width + x0)];
-				dx1 = indata[(z * width * height + y * width + x1)];
-				dy0 = indata[(z * width * height + y0 * width + x)];
-				dy1 = indata[(z * width * height + y1 * width + x)];
-				dz0 = indata[(z0 * width * height + y * width + x)];
-				dz1 = indata[(z1 * width * height + y * width + x)];
-				
-				int gX = ((dx1 - dx0) + 65535) / 2;
-				int gY = ((dy1 - dy0) + 65535) / 2; 
-				int gZ = ((dz1 - dz0) + 65535) / 2;
-				
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = gX * (255.0 / 65535.0);
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = gY * (255.0 / 65535.0);
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 2] = gZ * (255.0 / 65535.0);
-			}
-		}
-	}	
-	}
-	
-}
-
-void Image3D::Sobel(Image3D& inImg)
-{
-	if(inImg.pixelSize == 1)//8 bit monochrome images
-	{
-	unsigned char* d = (unsigned char*)inImg.data;
-	
-	std::vector<int> vals(27, 0); 
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
 				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-					
-				
-					
-				//xy plane				z0
-				vals[0] = d[(z0 * width * height + y0 * width + x0) * inImg.pixelSize];
-				vals[1] = d[(z0 * width * height + y0 * width + x) * inImg.pixelSize];
-				vals[2] = d[(z0 * width * height + y0 * width + x1) * inImg.pixelSize];
-				vals[3] = d[(z0 * width * height + y * width + x0) * inImg.pixelSize];
-				vals[4] = d[(z0 * width * height + y * width + x) * inImg.pixelSize];
-				vals[5] = d[(z0 * width * height + y * width + x1) * inImg.pixelSize];
-				vals[6] = d[(z0 * width * height + y1 * width + x0) * inImg.pixelSize];
-				vals[7] = d[(z0 * width * height + y1 * width + x) * inImg.pixelSize];
-				vals[8] = d[(z0 * width * height + y1 * width + x1) * inImg.pixelSize];
-				
-				//xy plane     z1
-				vals[9] = d[(z * width * height + y0 * width + x0) * inImg.pixelSize];
-				vals[10] = d[(z * width * height + y0 * width + x) * inImg.pixelSize];
-				vals[11] = d[(z * width * height + y0 * width + x1) * inImg.pixelSize];
-				vals[12] = d[(z * width * height + y * width + x0) * inImg.pixelSize];
-				vals[13] = d[(z * width * height + y * width + x) * inImg.pixelSize];
-				vals[14] = d[(z * width * height + y * width + x1) * inImg.pixelSize];
-				vals[15] = d[(z * width * height + y1 * width + x0) * inImg.pixelSize];
-				vals[16] = d[(z * width * height + y1 * width + x) * inImg.pixelSize];
-				vals[17] = d[(z * width * height + y1 * width + x1) * inImg.pixelSize];
-				
-				//xy plane     z2
-				vals[18] = d[(z1 * width * height + y0 * width + x0) * inImg.pixelSize];
-				vals[19] = d[(z1 * width * height + y0 * width + x) * inImg.pixelSize];
-				vals[20] = d[(z1 * width * height + y0 * width + x1) * inImg.pixelSize];
-				vals[21] = d[(z1 * width * height + y * width + x0) * inImg.pixelSize];
-				vals[22] = d[(z1 * width * height + y * width + x) * inImg.pixelSize];
-				vals[23] = d[(z1 * width * height + y * width + x1) * inImg.pixelSize];
-				vals[24] = d[(z1 * width * height + y1 * width + x0) * inImg.pixelSize];
-				vals[25] = d[(z1 * width * height + y1 * width + x) * inImg.pixelSize];
-				vals[26] = d[(z1 * width * height + y1 * width + x1) * inImg.pixelSize];
-				
-				
-				
-				double gradZ =(vals[0] * -1.0 + vals[1] * -2.0 + vals[2] * -1.0 +  
-							   vals[3] * -2.0 + vals[4] * -4.0 + vals[5] * -2.0 +  
-							   vals[6] * -1.0 + vals[7] * -2.0 + vals[8] * -1.0 + 
-							   
-							   vals[18] * 1.0 + vals[19] * 2.0 + vals[20] * 1.0 +  
-							   vals[21] * 2.0 + vals[22] * 4.0 + vals[23] * 2.0 +  
-							   vals[24] * 1.0 + vals[25] * 2.0 + vals[26] * 1.0)/16.0;
-							   
-							   
-				double gradY =(vals[0] * -1.0 + vals[1] * -2.0 + vals[2] * -1.0 + 
-							   vals[3] * 0    + vals[4] * 0    + vals[5] * 0 + 
-							   vals[6] * 1.0  + vals[7] * 2.0  + vals[8] * 1.0 + 
-							   
-							   vals[9] * -2.0 + vals[10] * -4.0 + vals[11] * -2.0 + 
-							   vals[12] * 0   + vals[13] * 0    + vals[14] * 0 + 
-							   vals[15] * 2.0 + vals[16] * 4.0  + vals[17] * 2.0 + 
-							   
-							   vals[18] * -1.0 + vals[19] * -2.0 + vals[20] * -1.0 + 
-							   vals[21] * 0    + vals[22] * 0    + vals[23] * 0 + 
-							   vals[24] * 1.0  + vals[25] * 2.0  + vals[26] * 1.0)/16.0;
-							   
-				double gradX = (vals[0] * -1.0 + vals[1] * 0 + vals[2] * 1.0 + 
-							   vals[3] * -2.0  + vals[4] * 0 + vals[5] * 2.0 + 
-							   vals[6] * -1.0  + vals[7] * 0 + vals[8] * 1.0 + 
-							   
-							   vals[9] *  -2.0 + vals[10] * 0 + vals[11] * 2.0 + 
-							   vals[12] * -4.0 + vals[13] * 0 + vals[14] * 4.0 + 
-							   vals[15] * -2.0 + vals[16] * 0 + vals[17] * 2.0 + 
-							   
-							   vals[18] * -1.0 + vals[19] * 0 + vals[20] * 1.0 + 
-							   vals[21] * -2.0 + vals[22] * 0 + vals[23] * 2.0 + 
-							   vals[24] * -1.0 + vals[25] * 0 + vals[26] * 1.0)/16.0;
-				
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = ((int)gradX + 255) / 2;
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = ((int)gradY + 255) / 2;
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 2] = ((int)gradZ + 255) / 2;
-			}
-		}
-	}
-	}
-	if(inImg.pixelSize == 2)//16 bit monochromeimages
-	{
-	uint16_t* d = (uint16_t*)inImg.data;
-	
-	std::vector<int> vals(27, 0); 
-	for(uint64_t z = 0; z < depth; z++)
-	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				int64_t x0 = x+1;
-				int64_t x1 = x-1;
-				int64_t y0 = y+1;
-				int64_t y1 = y-1;
-				int64_t z0 = z+1;
-				int64_t z1 = z-1;
-				
-				
-				if(x0 < 0 || x0 >= width) x0 = x;
-				if(x1 < 0 || x1 >= width) x1 = x;
-				if(y0 < 0 || y0 >= height) y0 = y;
-				if(y1 < 0 || y1 >= height) y1 = y;
-				if(z0 < 0 || z0 >= depth) z0 = z;
-				if(z1 < 0 || z1 >= depth) z1 = z;
-					
-					
-				
-					
-				//xy plane				z0
-				vals[0] = d[(z0 * width * height + y0 * width + x0)];
-				vals[1] = d[(z0 * width * height + y0 * width + x) ];
-				vals[2] = d[(z0 * width * height + y0 * width + x1) ];
-				vals[3] = d[(z0 * width * height + y * width + x0) ];
-				vals[4] = d[(z0 * width * height + y * width + x) ];
-				vals[5] = d[(z0 * width * height + y * width + x1) ];
-				vals[6] = d[(z0 * width * height + y1 * width + x0) ];
-				vals[7] = d[(z0 * width * height + y1 * width + x) ];
-				vals[8] = d[(z0 * width * height + y1 * width + x1) ];
-				
-				//xy plane     z1
-				vals[9] = d[(z * width * height + y0 * width + x0) ];
-				vals[10] = d[(z * width * height + y0 * width + x) ];
-				vals[11] = d[(z * width * height + y0 * width + x1) ];
-				vals[12] = d[(z * width * height + y * width + x0) ];
-				vals[13] = d[(z * width * height + y * width + x) ];
-				vals[14] = d[(z * width * height + y * width + x1) ];
-				vals[15] = d[(z * width * height + y1 * width + x0) ];
-				vals[16] = d[(z * width * height + y1 * width + x) ];
-				vals[17] = d[(z * width * height + y1 * width + x1) ];
-				
-				//xy plane     z2
-				vals[18] = d[(z1 * width * height + y0 * width + x0) ];
-				vals[19] = d[(z1 * width * height + y0 * width + x) ];
-				vals[20] = d[(z1 * width * height + y0 * width + x1) ];
-				vals[21] = d[(z1 * width * height + y * width + x0) ];
-				vals[22] = d[(z1 * width * height + y * width + x) ];
-				vals[23] = d[(z1 * width * height + y * width + x1) ];
-				vals[24] = d[(z1 * width * height + y1 * width + x0) ];
-				vals[25] = d[(z1 * width * height + y1 * width + x) ];
-				vals[26] = d[(z1 * width * height + y1 * width + x1) ];
-				
+				int64_t z1 = z-1;
 				
+				uint16_t* indata = (uint16_t*)inImg.Data();
 				
-				double gradZ =(vals[0] * -1.0 + vals[1] * -2.0 + vals[2] * -1.0 +  
-							   vals[3] * -2.0 + vals[4] * -4.0 + vals[5] * -2.0 +  
-							   vals[6] * -1.0 + vals[7] * -2.0 + vals[8] * -1.0 + 
-							   
-							   vals[18] * 1.0 + vals[19] * 2.0 + vals[20] * 1.0 +  
-							   vals[21] * 2.0 + vals[22] * 4.0 + vals[23] * 2.0 +  
-							   vals[24] * 1.0 + vals[25] * 2.0 + vals[26] * 1.0)/16.0;
-							   
-							   
-				double gradY =(vals[0] * -1.0 + vals[1] * -2.0 + vals[2] * -1.0 + 
-							   vals[3] * 0    + vals[4] * 0    + vals[5] * 0 + 
-							   vals[6] * 1.0  + vals[7] * 2.0  + vals[8] * 1.0 + 
-							   
-							   vals[9] * -2.0 + vals[10] * -4.0 + vals[11] * -2.0 + 
-							   vals[12] * 0   + vals[13] * 0    + vals[14] * 0 + 
-							   vals[15] * 2.0 + vals[16] * 4.0  + vals[17] * 2.0 + 
-							   
-							   vals[18] * -1.0 + vals[19] * -2.0 + vals[20] * -1.0 + 
-							   vals[21] * 0    + vals[22] * 0    + vals[23] * 0 + 
-							   vals[24] * 1.0  + vals[25] * 2.0  + vals[26] * 1.0)/16.0;
-							   
-				double gradX = (vals[0] * -1.0 + vals[1] * 0 + vals[2] * 1.0 + 
-							   vals[3] * -2.0  + vals[4] * 0 + vals[5] * 2.0 + 
-							   vals[6] * -1.0  + vals[7] * 0 + vals[8] * 1.0 + 
-							   
-							   vals[9] *  -2.0 + vals[10] * 0 + vals[11] * 2.0 + 
-							   vals[12] * -4.0 + vals[13] * 0 + vals[14] * 4.0 + 
-							   vals[15] * -2.0 + vals[16] * 0 + vals[17] * 2.0 + 
-							   
-							   vals[18] * -1.0 + vals[19] * 0 + vals[20] * 1.0 + 
-							   vals[21] * -2.0 + vals[22] * 0 + vals[23] * 2.0 + 
-							   vals[24] * -1.0 + vals[25] * 0 + vals[26] * 1.0)/16.0;
+				int dx0;
+				int dx1;
+				int dy0;
+				int dy1;
+				int dz0;
+				int dz1; 
 				
+				if(x0 < 0 || x0 >= width) x0 = x;
+				if(x1 < 0 || x1 >= width) x1 = x;
+				if(y0 < 0 || y0 >= height) y0 = y;
+				if(y1 < 0 || y1 >= height) y1 = y;
+				if(z0 < 0 || z0 >= depth) z0 = z;
+				if(z1 < 0 || z1 >= depth) z1 = z;
+					
+				dx0 = indata[(z * width * height + y * width + x0)];
+				dx1 = indata[(z * width * height + y * width + x1)];
+				dy0 = indata[(z * width * height + y0 * width + x)];
+				dy1 = indata[(z * width * height + y1 * width + x)];
+				dz0 = indata[(z0 * width * height + y * width + x)];
+				dz1 = indata[(z1 * width * height + y * width + x)];
 				
-				double gX = (gradX + 65535.0) / 2.0;
-				double gY = (gradY + 65535.0) / 2.0;
-				double gZ = (gradZ + 65535.0) / 2.0;
+				int gX = ((dx1 - dx0) + 65535) / 2;
+				int gY = ((dy1 - dy0) + 65535) / 2; 
+				int gZ = ((dz1 - dz0) + 65535) / 2;
 				
 				
 				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = gX * (255.0 / 65535.0);
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = gY * (255.0 / 65535.0) ;
+				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 1] = gY * (255.0 / 65535.0);
 				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 2] = gZ * (255.0 / 65535.0);
 			}
 		}
+	}	
 	}
-	}
+	
+}
+
+void Image3D::Sobel(Image3D& inImg, GRADIENT_ENCODING encoding)
+{
+	InvalidateStatistics();
+	
+	ParallelFor(0, depth, [&](uint64_t zBegin, uint64_t zEnd)
+	{
+		Sobel(inImg, zBegin, zEnd, encoding);
+	});
+}
+
+//Slabs may run concurrently on disjoint z ranges, so this one leaves InvalidateStatistics to the caller
+void Image3D::Sobel(Image3D& inImg, uint64_t zBegin, uint64_t zEnd, GRADIENT_ENCODING encoding)
+{
+	if(inImg.pixelType != PIXEL_TYPE_UINT8 && inImg.pixelType != PIXEL_TYPE_UINT16)
+		return;
+	if(encoding == GRADIENT_ENCODING_NONE)
+		return;
+	
+	SobelGradientSlab(inImg.data, inImg.pixelSize, (unsigned char*)data, width, height, depth, zBegin, zEnd, encoding);
 }
 
 void Image3D::Sobel2(Image3D& inImg)
 {
+	InvalidateStatistics();
+	
 	if(inImg.pixelSize == 1)//8 bit monochrome images
 	{
 	unsigned char* d = (unsigned char*)inImg.data;
@@ -1035,198 +960,525 @@ void Image3D::Sobel2(Image3D& inImg)
 	}
 }
 
-void Image3D::Normalize()
+template<class T> static void RunDownsample(Image3D& inImg, Image3D& outImg, int channels, DOWNSAMPLE_FILTER filter)
 {
-	if(pixelSize == 1)//8 bit monochrome images
+	const T* in = (const T*)inImg.Data();
+	T* out = (T*)outImg.Data();
+	
+	ParallelFor(0, outImg.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 	{
-	unsigned char minD = 255;
-	unsigned char maxD = 0; 
+		DownsampleSlab<T>(in, out, inImg.Width(), inImg.Height(), inImg.Depth(), channels, filter, zBegin, zEnd);
+	});
+}
+
+void Image3D::Downsample(Image3D& inImg, DOWNSAMPLE_FILTER filter)
+{
+	Deallocate();
+	Allocate((inImg.width + 1) / 2, (inImg.height + 1) / 2, (inImg.depth + 1) / 2, inImg.pixelSize);
+	pixelType = inImg.pixelType;
+	SetSpacing(inImg.spacingX * inImg.width / width, inImg.spacingY * inImg.height / height, inImg.spacingZ * inImg.depth / depth);
 	
-	for(uint64_t z = 0; z < depth; z++)
+	//RAW images (gradients, colour) are filtered as interleaved 8 bit channels
+	switch(pixelType)
 	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				unsigned char* indata = (unsigned char*)Data();
-				
-				unsigned char d = indata[(z * width * height + y * width + x) * pixelSize];
-				
-				if(d < minD )
-					minD = d;
-				
-				if(d > maxD)
-					maxD = d; 
-			
-			}
-		}
+		case PIXEL_TYPE_UINT8:
+			RunDownsample<uint8_t>(inImg, *this, 1, filter);
+			break;
+		case PIXEL_TYPE_UINT16:
+			RunDownsample<uint16_t>(inImg, *this, 1, filter);
+			break;
+		case PIXEL_TYPE_INT16:
+			RunDownsample<int16_t>(inImg, *this, 1, filter);
+			break;
+		case PIXEL_TYPE_FLOAT:
+			RunDownsample<float>(inImg, *this, 1, filter);
+			break;
+		default:
+			RunDownsample<uint8_t>(inImg, *this, pixelSize, filter);
+			break;
 	}
+}
+
+//Same voxel type as img at a new size, RAW images keep their pixel size
+static void AllocateLike(Image3D& img, Image3D* outImg, uint64_t W, uint64_t H, uint64_t D)
+{
+	if(img.Type() == PIXEL_TYPE_RAW)
+		outImg->Allocate(W, H, D, img.PixelSize());
+	else
+		outImg->Allocate(W, H, D, img.Type());
+}
+
+//One pass per axis that changes size, x runs over rows, y over slices and z over output slices
+template<class T> static void RunResample(Image3D& img, uint64_t outW, uint64_t outH, uint64_t outD, int channels)
+{
+	ResampleTaps axis;
 	
-	double scaleFactor = 255.0 / (double)(maxD - minD); 
-	for(uint64_t z = 0; z < depth; z++)
+	if(outW != img.Width())
 	{
-		for(uint64_t y = 0; y < height; y++)
+		Image3D outImg;
+		AllocateLike(img, &outImg, outW, img.Height(), img.Depth());
+		ResampleAxisTaps(img.Width(), outW, &axis);
+		const T* in = (const T*)img.Data();
+		T* out = (T*)outImg.Data();
+		ParallelFor(0, img.Height() * img.Depth(), [&](uint64_t rowBegin, uint64_t rowEnd)
 		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				unsigned char* indata = (unsigned char*)Data();
-				
-				unsigned char d = indata[(z * width * height + y * width + x) * pixelSize];
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = (d - minD) * scaleFactor;
-			}
-		}
-	}
+			ResampleRowsX<T>(in, out, img.Width(), outW, channels, axis, rowBegin, rowEnd);
+		});
+		img.Swap(outImg);
 	}
-	if(pixelSize == 2)//16 bit monochromeimages
-	{
-	uint16_t minD = 65535;
-	uint16_t maxD = 0; 
 	
-	for(uint64_t z = 0; z < depth; z++)
+	if(outH != img.Height())
 	{
-		for(uint64_t y = 0; y < height; y++)
+		Image3D outImg;
+		AllocateLike(img, &outImg, img.Width(), outH, img.Depth());
+		ResampleAxisTaps(img.Height(), outH, &axis);
+		const T* in = (const T*)img.Data();
+		T* out = (T*)outImg.Data();
+		int64_t rowLength = img.Width() * channels;
+		ParallelFor(0, img.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				uint16_t* indata = (uint16_t*)Data();
-				
-				uint16_t d = indata[(z * width * height + y * width + x)];
-				
-				if(d < minD )
-					minD = d;
-				
-				if(d > maxD)
-					maxD = d; 
-			
-			}
-		}
+			std::vector<float> sum;
+			for(uint64_t z = zBegin; z < zEnd; z++)
+				ResampleLines<T>(in + z * img.Height() * rowLength, out + z * outH * rowLength, rowLength, axis, 0, outH, sum);
+		});
+		img.Swap(outImg);
 	}
 	
-	double scaleFactor = 65535.0 / (double)(maxD - minD); 
-	for(uint64_t z = 0; z < depth; z++)
+	if(outD != img.Depth())
 	{
-		for(uint64_t y = 0; y < height; y++)
+		Image3D outImg;
+		AllocateLike(img, &outImg, img.Width(), img.Height(), outD);
+		ResampleAxisTaps(img.Depth(), outD, &axis);
+		const T* in = (const T*)img.Data();
+		T* out = (T*)outImg.Data();
+		ParallelFor(0, outD, [&](uint64_t zBegin, uint64_t zEnd)
 		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				uint16_t* indata = (uint16_t*)Data();
-				
-				uint16_t d = indata[(z * width * height + y * width + x)];
-				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = (d - minD) * scaleFactor;
-			}
-		}
+			std::vector<float> sum;
+			ResampleLines<T>(in, out, img.Width() * img.Height() * channels, axis, zBegin, zEnd, sum);
+		});
+		img.Swap(outImg);
 	}
+}
+
+void Image3D::Resample(double x, double y, double z)
+{
+	if(width == 0 || height == 0 || depth == 0 || x <= 0 || y <= 0 || z <= 0)
+		return;
+	
+	uint64_t outW = std::max<uint64_t>(1, (uint64_t)(width * spacingX / x + 0.5));
+	uint64_t outH = std::max<uint64_t>(1, (uint64_t)(height * spacingY / y + 0.5));
+	uint64_t outD = std::max<uint64_t>(1, (uint64_t)(depth * spacingZ / z + 0.5));
+	double extentX = width * spacingX;
+	double extentY = height * spacingY;
+	double extentZ = depth * spacingZ;
+	
+	//RAW images (gradients, colour) are filtered as interleaved 8 bit channels
+	switch(pixelType)
+	{
+		case PIXEL_TYPE_UINT8:
+			RunResample<uint8_t>(*this, outW, outH, outD, 1);
+			break;
+		case PIXEL_TYPE_UINT16:
+			RunResample<uint16_t>(*this, outW, outH, outD, 1);
+			break;
+		case PIXEL_TYPE_INT16:
+			RunResample<int16_t>(*this, outW, outH, outD, 1);
+			break;
+		case PIXEL_TYPE_FLOAT:
+			RunResample<float>(*this, outW, outH, outD, 1);
+			break;
+		default:
+			RunResample<uint8_t>(*this, outW, outH, outD, pixelSize);
+			break;
 	}
+	
+	SetSpacing(extentX / width, extentY / height, extentZ / depth);
+	InvalidateStatistics();
 }
 
-void Image3D::Histogram(std::vector<float>* histogram)
+void Image3D::ResampleIsotropic(double spacing)
 {
-	if(pixelSize == 1)//8 bit monochrome images
+	if(spacing <= 0)
+		spacing = std::min(spacingX, std::min(spacingY, spacingZ));
+	Resample(spacing, spacing, spacing);
+}
+
+void Image3D::Normalize(double lowPercent, double highPercent)
+{
+	if(pixelType != PIXEL_TYPE_UINT8 && pixelType != PIXEL_TYPE_UINT16)
+		return;
+	
+	//the full range comes from the min/max reduction, clipped ranges from the histogram
+	uint64_t minD;
+	uint64_t maxD;
+	if(lowPercent <= 0.0 && highPercent >= 100.0)
 	{
-	int bins = 256; 
-	histogram->resize(bins, 0);
+		if(!MinMax(&minD, &maxD))
+			return;
+	}
+	else
+	{
+		minD = Percentile(lowPercent);
+		maxD = Percentile(highPercent);
+	}
+	
+	if(maxD <= minD)
+		return;
+	
+	//the rescale is a point mapping as well, values outside the clipped range saturate
+	uint64_t bins = (uint64_t)1 << (8 * pixelSize);
+	double scaleFactor = (double)(bins - 1) / (double)(maxD - minD); 
+	std::vector<uint16_t> lut(bins + 1, 0);
+	for(uint64_t v = 0; v < bins; v++)
+	{
+		if(v <= minD)
+			lut[v] = 0;
+		else if(v >= maxD)
+			lut[v] = (maxD - minD) * scaleFactor;
+		else
+			lut[v] = (v - minD) * scaleFactor;
+	}
+	
+	ApplyLookupTable(*this, lut);
+}
+
+void Image3D::InvalidateStatistics()
+{
+	cachedMinMaxValid = false;
+	cachedMin = 0;
+	cachedMax = 0;
+	cachedHistogramValid = false;
+	cachedHistogram.clear();
+}
+
+//First and last non empty bin
+static bool MinMaxFromHistogram(std::vector<uint64_t>& counts, uint64_t* minValue, uint64_t* maxValue)
+{
+	size_t first = 0;
+	while(first < counts.size() && counts[first] == 0)
+		first++;
+	if(first == counts.size())
+		return false;
+	
+	size_t last = counts.size() - 1;
+	while(counts[last] == 0)
+		last--;
+	
+	*minValue = first;
+	*maxValue = last;
+	return true;
+}
+
+bool Image3D::MinMax(uint64_t* minValue, uint64_t* maxValue)
+{
+	if(pixelType != PIXEL_TYPE_UINT8 && pixelType != PIXEL_TYPE_UINT16)
+		return false;
+	
+	if(!cachedMinMaxValid && cachedHistogramValid)
+		cachedMinMaxValid = MinMaxFromHistogram(cachedHistogram, &cachedMin, &cachedMax);
 	
-	float maxBinCount = 0;
+	if(!cachedMinMaxValid)
+	{
+		if(ByteSize() == 0)
+			return false;
 		
-	for(uint64_t z = 0; z < depth; z++)
+		uint64_t sliceSize = width * height;
+		uint64_t minD = (uint64_t)-1;
+		uint64_t maxD = 0;
+		std::mutex mergeMutex;
+		
+		ParallelFor(0, depth, [&](uint64_t zBegin, uint64_t zEnd)
+		{
+			uint64_t slabMin = (uint64_t)-1;
+			uint64_t slabMax = 0;
+			MinMaxRange(data, pixelSize, zBegin * sliceSize, zEnd * sliceSize, &slabMin, &slabMax);
+			
+			std::lock_guard<std::mutex> lock(mergeMutex);
+			minD = std::min(minD, slabMin);
+			maxD = std::max(maxD, slabMax);
+		});
+		
+		cachedMin = minD;
+		cachedMax = maxD;
+		cachedMinMaxValid = true;
+	}
+	
+	*minValue = cachedMin;
+	*maxValue = cachedMax;
+	return true;
+}
+
+bool Image3D::MinMax(Image3DView inView, uint64_t* minValue, uint64_t* maxValue)
+{
+	if(inView.Type() != PIXEL_TYPE_UINT8 && inView.Type() != PIXEL_TYPE_UINT16)
+		return false;
+	if(inView.VoxelCount() == 0)
+		return false;
+	
+	uint64_t minD = (uint64_t)-1;
+	uint64_t maxD = 0;
+	std::mutex mergeMutex;
+	
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 	{
-		for(uint64_t y = 0; y < height; y++)
+		uint64_t slabMin = (uint64_t)-1;
+		uint64_t slabMax = 0;
+		for(uint64_t z = zBegin; z < zEnd; z++)
 		{
-			for(uint64_t x = 0; x < width; x++)
+			for(uint64_t y = 0; y < inView.Height(); y++)
 			{
-				unsigned char r = ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0];
-				(*histogram)[r] += 1.0f;
-				if((*histogram)[r] > maxBinCount && r != 0) 
-					maxBinCount = (*histogram)[r]; 
+				uint64_t rowMin = (uint64_t)-1;
+				uint64_t rowMax = 0;
+				MinMaxRange(inView.Row(y, z), inView.PixelSize(), 0, inView.Width(), &rowMin, &rowMax);
+				slabMin = std::min(slabMin, rowMin);
+				slabMax = std::max(slabMax, rowMax);
 			}
 		}
-	}
+		
+		std::lock_guard<std::mutex> lock(mergeMutex);
+		minD = std::min(minD, slabMin);
+		maxD = std::max(maxD, slabMax);
+	});
+	
+	*minValue = minD;
+	*maxValue = maxD;
+	return true;
+}
+
+uint64_t Image3D::Percentile(double percent)
+{
+	std::vector<uint64_t> counts;
+	HistogramCounts(&counts);
+	
+	uint64_t total = 0;
+	for(size_t i = 0; i < counts.size(); i++)
+		total += counts[i];
 	
-	for(int i = 0; i < bins; i++)
+	//smallest value with at least percent of the voxels at or below it
+	double target = std::max(0.0, std::min(100.0, percent)) / 100.0 * total;
+	uint64_t running = 0;
+	for(size_t i = 0; i < counts.size(); i++)
 	{
-		(*histogram)[i] = (*histogram)[i] / maxBinCount;
+		running += counts[i];
+		if(running > 0 && running >= target)
+			return i;
 	}
-	}
-	if(pixelSize == 2)//16 bit monochrome images
+	
+	return counts.empty() ? 0 : counts.size() - 1;
+}
+
+//Counts [zBegin, zEnd) into a private histogram and adds it to counts once at the end, under mergeMutex
+//when one is given
+template<class T> static void HistogramCountsTyped(Image3DView& inView, uint64_t zBegin, uint64_t zEnd, std::vector<uint64_t>* counts, std::mutex* mergeMutex)
+{
+	uint64_t bins = (uint64_t)std::numeric_limits<T>::max() + 1;
+	TypedImage3D<T> in = inView.Typed<T>();
+	
+	//32 bit counters keep the 16 bit histogram at 256KB, flushed before they can overflow
+	std::vector<uint32_t> local(bins, 0);
+	std::vector<uint64_t> slab(bins, 0);
+	uint64_t pending = 0;
+	
+	auto Flush = [&]()
 	{
-	int bins = 65536; 
-	histogram->resize(bins, 0);
+		for(uint64_t i = 0; i < bins; i++)
+			slab[i] += local[i];
+		std::fill(local.begin(), local.end(), 0);
+		pending = 0;
+	};
 	
-	float maxBinCount = 0;
-		
-	for(uint64_t z = 0; z < depth; z++)
+	auto CountRun = [&](T* v, uint64_t n)
 	{
-		for(uint64_t y = 0; y < height; y++)
+		while(n > 0)
 		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				uint16_t r = ((uint16_t*)data)[(z * width * height + y * width + x)];
-				(*histogram)[r] += 1.0f;
-				if((*histogram)[r] > maxBinCount && r != 0) 
-					maxBinCount = (*histogram)[r]; 
-			}
+			uint64_t block = std::min<uint64_t>(n, 0x40000000 - pending);
+			for(T* vEnd = v + block; v < vEnd; v++)
+				local[*v]++;
+			n -= block;
+			pending += block;
+			if(pending == 0x40000000)
+				Flush();
 		}
-	}
+	};
 	
-	for(int i = 0; i < bins; i++)
+	//a contiguous view is counted a slab at a time, anything else a row at a time
+	if(inView.IsContiguous())
+		CountRun(in.Row(0, zBegin), (zEnd - zBegin) * in.height * in.width);
+	else
+		for(uint64_t z = zBegin; z < zEnd; z++)
+			for(int64_t y = 0; y < in.height; y++)
+				CountRun(in.Row(y, z), in.width);
+	Flush();
+	
+	if(mergeMutex != NULL)
+		mergeMutex->lock();
+	if(counts->size() != bins)
+		counts->assign(bins, 0);
+	for(uint64_t i = 0; i < bins; i++)
+		(*counts)[i] += slab[i];
+	if(mergeMutex != NULL)
+		mergeMutex->unlock();
+}
+
+static void HistogramCountsView(Image3DView& inView, uint64_t zBegin, uint64_t zEnd, std::vector<uint64_t>* counts, std::mutex* mergeMutex)
+{
+	if(inView.Type() == PIXEL_TYPE_UINT8)//8 bit monochrome images
+		HistogramCountsTyped<uint8_t>(inView, zBegin, zEnd, counts, mergeMutex);
+	else if(inView.Type() == PIXEL_TYPE_UINT16)//16 bit monochrome images
+		HistogramCountsTyped<uint16_t>(inView, zBegin, zEnd, counts, mergeMutex);
+}
+
+void Image3D::HistogramCountsSlab(uint64_t zBegin, uint64_t zEnd, std::vector<uint64_t>* counts, std::mutex* mergeMutex)
+{
+	Image3DView view = View();
+	HistogramCountsView(view, zBegin, zEnd, counts, mergeMutex);
+}
+
+void Image3D::HistogramCounts(Image3DView inView, std::vector<uint64_t>* counts)
+{
+	counts->clear();
+	if(inView.Type() != PIXEL_TYPE_UINT8 && inView.Type() != PIXEL_TYPE_UINT16)
+		return;
+	
+	std::mutex mergeMutex;
+	counts->assign((uint64_t)1 << (8 * inView.PixelSize()), 0);
+	ParallelFor(0, inView.Depth(), [&](uint64_t zBegin, uint64_t zEnd)
 	{
-		(*histogram)[i] = (*histogram)[i] / maxBinCount;
-	}
-	}
+		HistogramCountsView(inView, zBegin, zEnd, counts, &mergeMutex);
+	});
 }
 
-void Image3D::BrightnessContrastThreshold(double brightness, double contrast, double threshold)
+void Image3D::HistogramCounts(std::vector<uint64_t>* counts)
 {
-	if(pixelSize == 1)//8 bit monochrome images
+	if(!cachedHistogramValid && (pixelType == PIXEL_TYPE_UINT8 || pixelType == PIXEL_TYPE_UINT16))
 	{
-	for(uint64_t z = 0; z < depth; z++)
+		//each thread counts its z slab privately, the slabs are summed once at the end
+		std::mutex mergeMutex;
+		cachedHistogram.assign((uint64_t)1 << (8 * pixelSize), 0);
+		ParallelFor(0, depth, [&](uint64_t zBegin, uint64_t zEnd)
+		{
+			HistogramCountsSlab(zBegin, zEnd, &cachedHistogram, &mergeMutex);
+		});
+		cachedHistogramValid = true;
+	}
+	
+	if(cachedHistogramValid)
+		*counts = cachedHistogram;
+	else
+		counts->clear();
+}
+
+void Image3D::SetHistogramCounts(std::vector<uint64_t>& counts)
+{
+	cachedHistogram = counts;
+	cachedHistogramValid = true;
+	cachedMinMaxValid = false;
+}
+
+void Image3D::NormalizeHistogram(std::vector<uint64_t>& counts, std::vector<float>* histogram)
+{
+	//bin 0 is usually the background and would flatten everything else
+	uint64_t maxBinCount = 0;
+	for(size_t i = 1; i < counts.size(); i++)
+		maxBinCount = std::max(maxBinCount, counts[i]);
+	if(maxBinCount == 0)
+		maxBinCount = 1;
+	
+	histogram->resize(counts.size());
+	for(size_t i = 0; i < counts.size(); i++)
+		(*histogram)[i] = (float)counts[i] / (float)maxBinCount;
+}
+
+void Image3D::Histogram(std::vector<float>* histogram)
+{
+	std::vector<uint64_t> counts;
+	HistogramCounts(&counts);
+	NormalizeHistogram(counts, histogram);
+}
+
+void Image3D::LookupTableHistogram(std::vector<uint64_t>& counts, std::vector<uint16_t>& lut, std::vector<uint64_t>* outCounts)
+{
+	//a lookup table is a point mapping, every voxel of bin v ends up in bin lut[v] so no voxel has to be visited
+	std::vector<uint64_t> mapped(counts.size(), 0);
+	for(size_t v = 0; v < counts.size(); v++)
+		mapped[lut[v]] += counts[v];
+	outCounts->swap(mapped);
+}
+
+void Image3D::BrightnessContrastThresholdLUT(std::vector<BrightnessContrastThresholdSettings>& steps, uint64_t bins, std::vector<uint16_t>* lut)
+{
+	double maxValue = (double)bins - 1.0;
+	
+	//one entry per value plus padding for the gathers in ApplyLookupTableRange
+	lut->assign(bins + 1, 0);
+	
+	for(uint64_t v = 0; v < bins; v++)
 	{
-		for(uint64_t y = 0; y < height; y++)
+		//steps are chained in double precision and only the final value is quantised
+		double vf = (double)v / maxValue;
+		
+		for(size_t i = 0; i < steps.size(); i++)
 		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				unsigned char v = ((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0];
-				
-				double vf = (double)v / 255.0;
-				
-				vf = vf * contrast + brightness; 
-				vf = vf > threshold ? vf : 0.0;
-				if(vf < 0.0) vf = 0.0;
-				if(vf > 1.0) vf = 1.0; 
-				
-				((unsigned char*)data)[(z * width * height + y * width + x) * pixelSize + 0] = vf * 255;
-				
-			}
+			vf = vf * steps[i].contrast + steps[i].brightness; 
+			vf = vf > steps[i].threshold ? vf : 0.0;
+			if(vf < 0.0) vf = 0.0;
+			if(vf > 1.0) vf = 1.0; 
 		}
+		
+		(*lut)[v] = vf * maxValue;
 	}
+}
+
+void Image3D::ApplyLookupTable(Image3D& inImg, std::vector<uint16_t>& lut)
+{
+	if(inImg.pixelType != PIXEL_TYPE_UINT8 && inImg.pixelType != PIXEL_TYPE_UINT16)
+		return;
+	
+	if(lut.size() != ((uint64_t)1 << (8 * inImg.pixelSize)) + 1)
+	{
+		std::cout << "Image3D: lookup table does not match the image bit depth" << std::endl;
+		return;
 	}
-	else if(pixelSize == 2)//16 bit monochrome images
+	
+	if(this != &inImg && (width != inImg.width || height != inImg.height || depth != inImg.depth || pixelType != inImg.pixelType))
 	{
-	for(uint64_t z = 0; z < depth; z++)
+		Deallocate();
+		Allocate(inImg.width, inImg.height, inImg.depth, inImg.pixelType);
+	}
+	SetSpacing(inImg.spacingX, inImg.spacingY, inImg.spacingZ);
+	
+	//the histogram of the result follows from the input's one without a scan
+	std::vector<uint64_t> mappedHistogram;
+	bool histogramKnown = inImg.cachedHistogramValid;
+	if(histogramKnown)
+		LookupTableHistogram(inImg.cachedHistogram, lut, &mappedHistogram);
+	
+	uint64_t sliceSize = width * height;
+	
+	ParallelFor(0, depth, [&](uint64_t zBegin, uint64_t zEnd)
 	{
-		for(uint64_t y = 0; y < height; y++)
-		{
-			for(uint64_t x = 0; x < width; x++)
-			{
-				
-				uint16_t v = ((uint16_t*)data)[(z * width * height + y * width + x)];
-				
-				double vf = (double)v / 65535.0;
-				
-				vf = vf * contrast + brightness; 
-				vf = vf > threshold ? vf : 0.0;
-				if(vf < 0.0) vf = 0.0;
-				if(vf > 1.0) vf = 1.0; 
-				
-				((uint16_t*)data)[(z * width * height + y * width + x)] = vf * 65535;
-				
-			}
-		}
-	}	
+		ApplyLookupTableRange(inImg.data, data, pixelSize, lut.data(), zBegin * sliceSize, zEnd * sliceSize);
+	});
+	
+	InvalidateStatistics();
+	if(histogramKnown)
+	{
+		cachedHistogram.swap(mappedHistogram);
+		cachedHistogramValid = true;
 	}
-}
\ No newline at end of file
+}
+
+void Image3D::BrightnessContrastThreshold(double brightness, double contrast, double threshold)
+{
+	if(pixelType != PIXEL_TYPE_UINT8 && pixelType != PIXEL_TYPE_UINT16)
+		return;
+	
+	std::vector<BrightnessContrastThresholdSettings> steps(1);
+	steps[0].brightness = brightness;
+	steps[0].contrast = contrast;
+	steps[0].threshold = threshold;
+	
+	std::vector<uint16_t> lut;
+	BrightnessContrastThresholdLUT(steps, (uint64_t)1 << (8 * pixelSize), &lut);
+	ApplyLookupTable(*this, lut);
+}
@@ -2,6 +2,24 @@
 
 
 #include "Common.hpp"
+#include "TypedImage3D.hpp"
+#include "Image3DView.hpp"
+#include "MappedBuffer.hpp"
+#include "Processing/Downsample.hpp"
+#include "Processing/SobelGradient.hpp"
+#include "Processing/ConnectedComponents.hpp"
+
+#include <mutex>
+
+
+//One Brightness Contrast Threshold step, applied to intensities scaled to 0-1 as
+//clamp(v * contrast + brightness), with results not above threshold set to 0
+struct BrightnessContrastThresholdSettings
+{
+	double brightness;
+	double contrast;
+	double threshold;
+};
 
 
 class Image3D
@@ -11,28 +29,118 @@ class Image3D
 		uint64_t height;
 		uint64_t depth;
 		uint64_t pixelSize;
+		PIXEL_TYPE pixelType;
 		void* data;
+		MappedBuffer mappedData;//holds data when the image lives in the backing store
+		double spacingX;//physical voxel size, Allocate resets it to 1 for sources that have none
+		double spacingY;
+		double spacingZ;
+		
+		//statistics of the 8 and 16 bit images, kept until the voxels change
+		bool cachedMinMaxValid;
+		uint64_t cachedMin;
+		uint64_t cachedMax;
+		bool cachedHistogramValid;
+		std::vector<uint64_t> cachedHistogram;
 		
 	public:
 		Image3D();
 		Image3D(uint64_t W, uint64_t H, uint64_t D, uint64_t P);
+		Image3D(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type);
 		~Image3D();
+		
+		//an image owns its voxels, it can be moved but not copied
+		Image3D(Image3D&& other);
+		Image3D& operator=(Image3D&& other);
+		Image3D(const Image3D&) = delete;
+		Image3D& operator=(const Image3D&) = delete;
+		
 		void Allocate(uint64_t W, uint64_t H, uint64_t D, uint64_t P);
+		void Allocate(uint64_t W, uint64_t H, uint64_t D, PIXEL_TYPE type);
 		void Deallocate(); 
-		void* Data();
+		
+		//Images of at least minBytes are allocated in temporary files under directory instead of RAM.
+		//An empty directory turns this off. Until this is called the VOLUMETRIC_RENDERER_SWAP_DIR and
+		//VOLUMETRIC_RENDERER_SWAP_MIN_MB (default 256) environment variables are used.
+		static void SetBackingStore(std::string directory, uint64_t minBytes);
+		bool IsMapped();
+		void Advise(MAPPED_ADVICE advice, uint64_t zBegin, uint64_t zEnd);//no-op unless IsMapped()
+		void* Data();//call InvalidateStatistics after writing through this
 		uint64_t Width();
 		uint64_t Height();
 		uint64_t Depth();
+		PIXEL_TYPE Type();
+		uint64_t PixelSize();
 		uint64_t ByteSize();
+		void SetSpacing(double x, double y, double z);
+		double SpacingX();
+		double SpacingY();
+		double SpacingZ();
+		
+		//typed view of the voxels, T must match Type()
+		template<class T> TypedImage3D<T> Typed()
+		{
+			return TypedImage3D<T>((T*)data, width, height, depth);
+		}
+		
+		//the whole image, narrow it down with Region, Slab or Slice
+		Image3DView View();
+		
+		void Swap(Image3D& other);
 		void Copy(Image3D& inImg);
-		void Smooth2D();
-		void Median2D();
-		void Smooth();
-		void Median();
+		void Assign(Image3DView inView);//allocates to the size of the view and copies its voxels
+		
+		//The filters replace the image with the filtered image. The forms that take a view replace it
+		//with the filtered view instead, at the size of the view, which may be a view of this image.
+		void Smooth2D(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Smooth2D(Image3DView inView, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median2D(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median2D(Image3DView inView, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Smooth(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Smooth(Image3DView inView, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median(BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Median(Image3DView inView, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void MedianRadius(int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);//radius 1 to 5, planar filters each z slice on its own
+		void MedianRadius(Image3DView inView, int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		
+		//Grey value morphology with a box of 2 * radius + 1 voxels per axis, planar filters each z slice on
+		//its own. Voxels outside the volume are ignored, BOUNDARY_ZERO treats them as 0 instead.
+		void Erode(int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Dilate(int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Erode(Image3DView inView, int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Dilate(Image3DView inView, int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);
+		void Open(int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);//erode then dilate, removes bright specks
+		void Close(int radius, bool planar = false, BOUNDARY_MODE mode = BOUNDARY_CLAMP);//dilate then erode, fills dark holes
+		
+		//Components of the nonzero voxels, labels gets one entry per voxel with 0 for the background and
+		//1 to n for the components, components[label - 1] their sizes and bounds. Returns n.
+		uint32_t LabelComponents(std::vector<uint32_t>* labels, std::vector<ComponentInfo>* components, CONNECTIVITY connectivity = CONNECTIVITY_26);
+		void KeepLargestComponent(CONNECTIVITY connectivity = CONNECTIVITY_26);//sets every voxel outside the largest component to 0
 		void CentralDifference(Image3D& inImg);
-		void Sobel(Image3D& inImg);
+		void Sobel(Image3D& inImg, GRADIENT_ENCODING encoding = GRADIENT_ENCODING_RGB8);
+		void Sobel(Image3D& inImg, uint64_t zBegin, uint64_t zEnd, GRADIENT_ENCODING encoding = GRADIENT_ENCODING_RGB8);
 		void Sobel2(Image3D& inImg);
-		void Normalize();
+		void Downsample(Image3D& inImg, DOWNSAMPLE_FILTER filter = DOWNSAMPLE_GAUSSIAN);//half size in every axis, rounded up
+		
+		//Resamples to the given voxel spacing, see Processing/Resample.hpp. Voxel counts are rounded so
+		//the spacing that results is adjusted to keep the physical extent.
+		void Resample(double x, double y, double z);
+		void ResampleIsotropic(double spacing = 0);//0 resamples to the finest of the three spacings
+		void Normalize(double lowPercent = 0.0, double highPercent = 100.0);
+		void InvalidateStatistics();
+		bool MinMax(uint64_t* minValue, uint64_t* maxValue);
+		uint64_t Percentile(double percent);
+		void HistogramCounts(std::vector<uint64_t>* counts);
+		void HistogramCountsSlab(uint64_t zBegin, uint64_t zEnd, std::vector<uint64_t>* counts, std::mutex* mergeMutex = NULL);
+		
+		//statistics of a part of an 8 or 16 bit image, not cached
+		static bool MinMax(Image3DView inView, uint64_t* minValue, uint64_t* maxValue);
+		static void HistogramCounts(Image3DView inView, std::vector<uint64_t>* counts);
+		void SetHistogramCounts(std::vector<uint64_t>& counts);
 		void Histogram(std::vector<float>* histogram);
+		static void NormalizeHistogram(std::vector<uint64_t>& counts, std::vector<float>* histogram);
+		static void LookupTableHistogram(std::vector<uint64_t>& counts, std::vector<uint16_t>& lut, std::vector<uint64_t>* outCounts);
+		static void BrightnessContrastThresholdLUT(std::vector<BrightnessContrastThresholdSettings>& steps, uint64_t bins, std::vector<uint16_t>* lut);
+		void ApplyLookupTable(Image3D& inImg, std::vector<uint16_t>& lut);
 		void BrightnessContrastThreshold(double brightness, double contrast, double threshold);
 };
\ No newline at end of file
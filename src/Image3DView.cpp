@@ -0,0 +1,130 @@
+#include "Image3DView.hpp"
+
+
+Image3DView::Image3DView()
+{
+	data = NULL;
+	width = 0;
+	height = 0;
+	depth = 0;
+	pixelSize = 0;
+	pixelType = PIXEL_TYPE_RAW;
+	rowStride = 0;
+	sliceStride = 0;
+	spacingX = 1;
+	spacingY = 1;
+	spacingZ = 1;
+}
+
+Image3DView::Image3DView(void* d, uint64_t W, uint64_t H, uint64_t D, uint64_t P, PIXEL_TYPE type, uint64_t rowStep, uint64_t sliceStep) : Image3DView()
+{
+	data = (unsigned char*)d;
+	width = W;
+	height = H;
+	depth = D;
+	pixelSize = P;
+	pixelType = type;
+	rowStride = rowStep;
+	sliceStride = sliceStep;
+}
+
+void Image3DView::SetSpacing(double x, double y, double z)
+{
+	spacingX = x;
+	spacingY = y;
+	spacingZ = z;
+}
+
+double Image3DView::SpacingX()
+{
+	return spacingX;
+}
+
+double Image3DView::SpacingY()
+{
+	return spacingY;
+}
+
+double Image3DView::SpacingZ()
+{
+	return spacingZ;
+}
+
+void* Image3DView::Data()
+{
+	return data;
+}
+
+uint64_t Image3DView::Width()
+{
+	return width;
+}
+
+uint64_t Image3DView::Height()
+{
+	return height;
+}
+
+uint64_t Image3DView::Depth()
+{
+	return depth;
+}
+
+PIXEL_TYPE Image3DView::Type()
+{
+	return pixelType;
+}
+
+uint64_t Image3DView::PixelSize()
+{
+	return pixelSize;
+}
+
+uint64_t Image3DView::RowStride()
+{
+	return rowStride;
+}
+
+uint64_t Image3DView::SliceStride()
+{
+	return sliceStride;
+}
+
+uint64_t Image3DView::VoxelCount()
+{
+	return width * height * depth;
+}
+
+bool Image3DView::IsContiguous()
+{
+	return (rowStride == width || height <= 1) && (sliceStride == width * height || depth <= 1);
+}
+
+void* Image3DView::Row(uint64_t y, uint64_t z)
+{
+	return data + (z * sliceStride + y * rowStride) * pixelSize;
+}
+
+Image3DView Image3DView::Region(uint64_t x, uint64_t y, uint64_t z, uint64_t W, uint64_t H, uint64_t D)
+{
+	x = std::min(x, width);
+	y = std::min(y, height);
+	z = std::min(z, depth);
+	W = std::min(W, width - x);
+	H = std::min(H, height - y);
+	D = std::min(D, depth - z);
+	
+	Image3DView view(data + (z * sliceStride + y * rowStride + x) * pixelSize, W, H, D, pixelSize, pixelType, rowStride, sliceStride);
+	view.SetSpacing(spacingX, spacingY, spacingZ);
+	return view;
+}
+
+Image3DView Image3DView::Slab(uint64_t zBegin, uint64_t zEnd)
+{
+	return Region(0, 0, zBegin, width, height, zEnd > zBegin ? zEnd - zBegin : 0);
+}
+
+Image3DView Image3DView::Slice(uint64_t z)
+{
+	return Region(0, 0, z, width, height, 1);
+}
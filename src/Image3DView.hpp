@@ -0,0 +1,55 @@
+#pragma once
+
+
+#include "Common.hpp"
+#include "TypedImage3D.hpp"
+
+
+//Non owning window onto the voxels of an Image3D, a region, slab or slice of it. Rows are RowStride()
+//and slices SliceStride() voxels apart in the underlying image, so a view is read and written in place
+//without a copy. A view stays valid while its image is not reallocated, moving the image keeps it valid.
+class Image3DView
+{
+	protected:
+		unsigned char* data;
+		uint64_t width;
+		uint64_t height;
+		uint64_t depth;
+		uint64_t pixelSize;
+		PIXEL_TYPE pixelType;
+		uint64_t rowStride;//in voxels
+		uint64_t sliceStride;
+		double spacingX;
+		double spacingY;
+		double spacingZ;
+		
+	public:
+		Image3DView();
+		Image3DView(void* d, uint64_t W, uint64_t H, uint64_t D, uint64_t P, PIXEL_TYPE type, uint64_t rowStep, uint64_t sliceStep);
+		void SetSpacing(double x, double y, double z);
+		double SpacingX();
+		double SpacingY();
+		double SpacingZ();
+		void* Data();
+		uint64_t Width();
+		uint64_t Height();
+		uint64_t Depth();
+		PIXEL_TYPE Type();
+		uint64_t PixelSize();
+		uint64_t RowStride();
+		uint64_t SliceStride();
+		uint64_t VoxelCount();
+		bool IsContiguous();//rows and slices follow each other without gaps
+		void* Row(uint64_t y, uint64_t z);
+		
+		//sub views, clipped to this view
+		Image3DView Region(uint64_t x, uint64_t y, uint64_t z, uint64_t W, uint64_t H, uint64_t D);
+		Image3DView Slab(uint64_t zBegin, uint64_t zEnd);
+		Image3DView Slice(uint64_t z);
+		
+		//typed view of the voxels, T must match Type()
+		template<class T> TypedImage3D<T> Typed()
+		{
+			return TypedImage3D<T>((T*)data, width, height, depth, rowStride, sliceStride);
+		}
+};
@@ -0,0 +1,257 @@
+#include "MacrocellGrid.hpp"
+
+
+#include "Parallel.hpp"
+
+
+MacrocellGrid::MacrocellGrid()
+{
+	Clear();
+}
+
+void MacrocellGrid::Clear()
+{
+	cellSize = 0;
+	cellsX = 0;
+	cellsY = 0;
+	cellsZ = 0;
+	maxValue = 255;
+	minValues.clear();
+	maxValues.clear();
+}
+
+template<class T> static void CellRangesSlab(T* in, int64_t W, int64_t H, int64_t D, int64_t s, int64_t cellsX, int64_t cellsY, uint16_t* minValues, uint16_t* maxValues, int64_t czBegin, int64_t czEnd)
+{
+	//a gradient sample inside the cell interpolates Sobel voxels up to one voxel outside it, and those
+	//read one voxel further, so every cell covers a two voxel ring
+	const int64_t ring = 2;
+
+	std::vector<T> rowMin(cellsX);
+	std::vector<T> rowMax(cellsX);
+
+	for(int64_t cz = czBegin; cz < czEnd; cz++)
+	{
+		uint16_t* cellMin = minValues + cz * cellsX * cellsY;
+		uint16_t* cellMax = maxValues + cz * cellsX * cellsY;
+		std::fill(cellMin, cellMin + cellsX * cellsY, std::numeric_limits<uint16_t>::max());
+		std::fill(cellMax, cellMax + cellsX * cellsY, 0);
+
+		int64_t zBegin = std::max<int64_t>(0, cz * s - ring);
+		int64_t zEnd = std::min(D, (cz + 1) * s + ring);
+		for(int64_t z = zBegin; z < zEnd; z++)
+		{
+			for(int64_t y = 0; y < H; y++)
+			{
+				T* row = in + (z * H + y) * W;
+				for(int64_t cx = 0; cx < cellsX; cx++)
+				{
+					int64_t xBegin = std::max<int64_t>(0, cx * s - ring);
+					int64_t xEnd = std::min(W, (cx + 1) * s + ring);
+					T lo = row[xBegin];
+					T hi = row[xBegin];
+					for(int64_t x = xBegin + 1; x < xEnd; x++)
+					{
+						lo = std::min(lo, row[x]);
+						hi = std::max(hi, row[x]);
+					}
+					rowMin[cx] = lo;
+					rowMax[cx] = hi;
+				}
+
+				//the row belongs to every cell whose ringed y range contains it
+				int64_t cyBegin = std::max<int64_t>(0, std::max<int64_t>(0, y - ring) / s - 1);
+				int64_t cyEnd = std::min(cellsY, (y + ring) / s + 1);
+				for(int64_t cy = cyBegin; cy < cyEnd; cy++)
+				{
+					if(y < cy * s - ring || y >= (cy + 1) * s + ring)
+						continue;
+					for(int64_t cx = 0; cx < cellsX; cx++)
+					{
+						cellMin[cy * cellsX + cx] = std::min<uint16_t>(cellMin[cy * cellsX + cx], rowMin[cx]);
+						cellMax[cy * cellsX + cx] = std::max<uint16_t>(cellMax[cy * cellsX + cx], rowMax[cx]);
+					}
+				}
+			}
+		}
+	}
+}
+
+//Widens every range over the cells within radius along one axis, stride is the cell step of that axis
+static void DilateRanges(std::vector<uint16_t>& minValues, std::vector<uint16_t>& maxValues, uint64_t cellsX, uint64_t cellsY, uint64_t cellsZ, int axis, int64_t radius)
+{
+	int64_t counts[3] = {(int64_t)cellsX, (int64_t)cellsY, (int64_t)cellsZ};
+	int64_t strides[3] = {1, (int64_t)cellsX, (int64_t)(cellsX * cellsY)};
+	int64_t n = counts[axis];
+	int64_t stride = strides[axis];
+
+	std::vector<uint16_t> inMin = minValues;
+	std::vector<uint16_t> inMax = maxValues;
+
+	ParallelFor(0, cellsX * cellsY * cellsZ, [&](uint64_t begin, uint64_t end)
+	{
+		for(uint64_t i = begin; i < end; i++)
+		{
+			int64_t c = (i / stride) % n;
+			int64_t first = -std::min(radius, c);
+			int64_t last = std::min(radius, n - 1 - c);
+			uint16_t lo = inMin[i];
+			uint16_t hi = inMax[i];
+			for(int64_t d = first; d <= last; d++)
+			{
+				lo = std::min(lo, inMin[i + d * stride]);
+				hi = std::max(hi, inMax[i + d * stride]);
+			}
+			minValues[i] = lo;
+			maxValues[i] = hi;
+		}
+	});
+}
+
+bool MacrocellGrid::Build(Image3D& img, uint64_t cellVoxels, uint64_t dilation)
+{
+	if(img.Type() != PIXEL_TYPE_UINT8 && img.Type() != PIXEL_TYPE_UINT16)
+	{
+		std::cout << "MacrocellGrid: needs an 8 or 16 bit image" << std::endl;
+		Clear();
+		return false;
+	}
+
+	cellSize = std::max<uint64_t>(1, cellVoxels);
+	cellsX = (img.Width() + cellSize - 1) / cellSize;
+	cellsY = (img.Height() + cellSize - 1) / cellSize;
+	cellsZ = (img.Depth() + cellSize - 1) / cellSize;
+	maxValue = img.Type() == PIXEL_TYPE_UINT8 ? 255 : 65535;
+	minValues.resize(CellCount());
+	maxValues.resize(CellCount());
+
+	ParallelFor(0, cellsZ, [&](uint64_t czBegin, uint64_t czEnd)
+	{
+		if(img.Type() == PIXEL_TYPE_UINT8)
+			CellRangesSlab((uint8_t*)img.Data(), img.Width(), img.Height(), img.Depth(), cellSize, cellsX, cellsY, minValues.data(), maxValues.data(), czBegin, czEnd);
+		else
+			CellRangesSlab((uint16_t*)img.Data(), img.Width(), img.Height(), img.Depth(), cellSize, cellsX, cellsY, minValues.data(), maxValues.data(), czBegin, czEnd);
+	});
+
+	//samples within half a voxel of the faces blend with the zero border colour
+	for(uint64_t cz = 0; cz < cellsZ; cz++)
+		for(uint64_t cy = 0; cy < cellsY; cy++)
+			for(uint64_t cx = 0; cx < cellsX; cx++)
+				if(cx == 0 || cy == 0 || cz == 0 || cx == cellsX - 1 || cy == cellsY - 1 || cz == cellsZ - 1)
+					minValues[(cz * cellsY + cy) * cellsX + cx] = 0;
+
+	if(dilation > 0)
+		for(int axis = 0; axis < 3; axis++)
+			DilateRanges(minValues, maxValues, cellsX, cellsY, cellsZ, axis, dilation);
+
+	return true;
+}
+
+void MacrocellGrid::OpaquePrefix(std::vector<float>& opacity, std::vector<uint32_t>* prefix)
+{
+	prefix->resize(opacity.size() + 1);
+	(*prefix)[0] = 0;
+	for(size_t i = 0; i < opacity.size(); i++)
+		(*prefix)[i + 1] = (*prefix)[i] + (opacity[i] > 0 ? 1 : 0);
+}
+
+void MacrocellGrid::Classify(std::vector<uint32_t>& opaquePrefix, float gradientThreshold, std::vector<uint8_t>* visible)
+{
+	visible->assign(CellCount(), 1);
+	int64_t entries = (int64_t)opaquePrefix.size() - 1;
+	if(entries <= 0)
+		return;
+
+	//a Sobel sum divided by 16 is at most the range of its neighbourhood on every axis, decoded that is
+	//(hi - lo) / 2 per axis. The slack covers the 8 bit rounding of the stored gradients.
+	const double gradientScale = 0.5 * sqrt(3.0);
+	const double gradientSlack = 2.0 * sqrt(3.0) / 255.0;
+
+	ParallelFor(0, CellCount(), [&](uint64_t begin, uint64_t end)
+	{
+		for(uint64_t i = begin; i < end; i++)
+		{
+			double lo = minValues[i] / maxValue;
+			double hi = maxValues[i] / maxValue;
+
+			//linear filtering mixes the two entries around v * entries - 0.5
+			int64_t first = std::max<int64_t>(0, (int64_t)floor(lo * entries - 0.5));
+			int64_t last = std::min<int64_t>(entries - 1, (int64_t)ceil(hi * entries - 0.5));
+			bool opaque = opaquePrefix[last + 1] > opaquePrefix[first];
+			bool steep = gradientScale * (hi - lo) + gradientSlack > gradientThreshold;
+			(*visible)[i] = opaque && steep ? 1 : 0;
+		}
+	});
+}
+
+//One axis of the distance transform, out[i] = min over j of max(|i - j|, in[j]) along each line of n
+//values stride apart. Lines start at every index that is 0 along the axis.
+static void ChebyshevPass(std::vector<uint8_t>& values, uint64_t cellsX, uint64_t cellsY, uint64_t cellsZ, int axis)
+{
+	int64_t counts[3] = {(int64_t)cellsX, (int64_t)cellsY, (int64_t)cellsZ};
+	int64_t strides[3] = {1, (int64_t)cellsX, (int64_t)(cellsX * cellsY)};
+	int64_t n = counts[axis];
+	int64_t stride = strides[axis];
+	uint64_t lines = cellsX * cellsY * cellsZ / n;
+
+	ParallelFor(0, lines, [&](uint64_t begin, uint64_t end)
+	{
+		std::vector<uint8_t> line(n);
+		for(uint64_t l = begin; l < end; l++)
+		{
+			//line l in the plane of the other two axes
+			int64_t start = axis == 0 ? l * n : axis == 1 ? (l / cellsX) * cellsX * cellsY + l % cellsX : l;
+			for(int64_t i = 0; i < n; i++)
+				line[i] = values[start + i * stride];
+
+			//candidates k cells away are never below k, the search ends once k reaches the best so far
+			for(int64_t i = 0; i < n; i++)
+			{
+				int64_t best = line[i];
+				for(int64_t k = 1; k < best; k++)
+				{
+					if(i - k >= 0)
+						best = std::min<int64_t>(best, std::max<int64_t>(k, line[i - k]));
+					if(i + k < n)
+						best = std::min<int64_t>(best, std::max<int64_t>(k, line[i + k]));
+				}
+				values[start + i * stride] = best;
+			}
+		}
+	});
+}
+
+void MacrocellGrid::DistanceField(std::vector<uint8_t>& visible, std::vector<uint8_t>* distance)
+{
+	distance->resize(CellCount());
+	for(uint64_t i = 0; i < CellCount(); i++)
+		(*distance)[i] = visible[i] ? 0 : 255;
+
+	//the max metric separates, one pass per axis gives the exact 3D distance
+	for(int axis = 0; axis < 3; axis++)
+		ChebyshevPass(*distance, cellsX, cellsY, cellsZ, axis);
+}
+
+uint64_t MacrocellGrid::CellSize()
+{
+	return cellSize;
+}
+
+uint64_t MacrocellGrid::CellsX()
+{
+	return cellsX;
+}
+
+uint64_t MacrocellGrid::CellsY()
+{
+	return cellsY;
+}
+
+uint64_t MacrocellGrid::CellsZ()
+{
+	return cellsZ;
+}
+
+uint64_t MacrocellGrid::CellCount()
+{
+	return cellsX * cellsY * cellsZ;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+
+#include "Common.hpp"
+#include "Image3D.hpp"
+
+
+//Coarse grid over an 8 or 16 bit volume holding the value range of every cell of cellSize^3 voxels.
+//Each range also covers the two voxel ring around the cell, which trilinear sampling of the intensity
+//and Sobel gradients inside the cell can reach, cells on the faces also include the zero border value.
+//The ranges are then widened over dilation neighbouring cells. Classify turns the ranges into one
+//visibility byte per cell for a transfer function, so the ray marcher can jump over invisible cells.
+class MacrocellGrid
+{
+	protected:
+		uint64_t cellSize;
+		uint64_t cellsX;
+		uint64_t cellsY;
+		uint64_t cellsZ;
+		double maxValue;//255 or 65535, ranges are normalised by this to match the texture values
+		std::vector<uint16_t> minValues;
+		std::vector<uint16_t> maxValues;
+
+	public:
+		MacrocellGrid();
+		bool Build(Image3D& img, uint64_t cellVoxels = 8, uint64_t dilation = 1);
+		void Clear();
+
+		//Summed table of the lookup table opacity, prefix[i] counts the entries below i with nonzero
+		//opacity. Any LUT range is tested for opacity with two reads, which keeps Classify constant time
+		//per cell no matter how wide the cell ranges are.
+		static void OpaquePrefix(std::vector<float>& opacity, std::vector<uint32_t>* prefix);
+
+		//visible[cell] is 0 when no sample in the cell can produce a surface: the opacity of the lookup
+		//table (linearly filtered) is zero over the cell's range, or the largest gradient the range
+		//allows is below gradientThreshold. opaquePrefix comes from OpaquePrefix.
+		void Classify(std::vector<uint32_t>& opaquePrefix, float gradientThreshold, std::vector<uint8_t>* visible);
+
+		//Chebyshev distance in cells from every cell to the nearest visible one, 0 for visible cells and
+		//capped at 255. A cell at distance d is the centre of an empty box 2d - 1 cells wide, so a ray
+		//can leap to that box's exit in one go.
+		void DistanceField(std::vector<uint8_t>& visible, std::vector<uint8_t>* distance);
+
+		uint64_t CellSize();
+		uint64_t CellsX();
+		uint64_t CellsY();
+		uint64_t CellsZ();
+		uint64_t CellCount();
+};
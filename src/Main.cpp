@@ -1,6 +1,7 @@
 #include <QtWidgets/QApplication>
 #include <QtWidgets/QStyleFactory>
 #include "MainWindow.hpp"
+#include "TestBrickedLayout.hpp"
 
 void SetDarkStyle()
 {
@@ -25,6 +26,15 @@ void SetDarkStyle()
 
 int main(int argc, char* argv[])
 {
+	if(argc > 1 && std::string(argv[1]) == "--benchmark-bricked")
+	{
+		uint64_t W = argc > 4 ? atoi(argv[2]) : 1024;
+		uint64_t H = argc > 4 ? atoi(argv[3]) : 1024;
+		uint64_t D = argc > 4 ? atoi(argv[4]) : 64;
+		TestBrickedLayout(W, H, D);
+		return 0;
+	}
+	
 	SetDarkStyle();
 		
 	QApplication app(argc, argv);
@@ -147,6 +147,12 @@ MainWindow::MainWindow()
 		renderViewport.SetBackFaceCulling(value);
 	});
 	
+	QObject::connect(controlPanel.comboGradientEncoding, QOverload<int>::of(&QComboBox::currentIndexChanged), [this](int index)
+	{
+		GRADIENT_ENCODING encodings[] = {GRADIENT_ENCODING_RGB8, GRADIENT_ENCODING_OCTAHEDRAL, GRADIENT_ENCODING_NONE};
+		renderViewport.SetGradientEncoding(encodings[std::max(0, std::min(index, 2))]);
+	});
+	
 	QObject::connect(controlPanel.scalarChooserBrightness, &ScalarChooser::valueChanged, [this](double value)
 	{
 		renderViewport.SetBrightness(value);
@@ -191,6 +197,16 @@ MainWindow::MainWindow()
 		renderViewport.volumeData->ApplyBCTSettings(brightness, contrast, t);
 	});
 	
+	QObject::connect(controlPanel.buttonBrightnessContrastUndo, &QPushButton::clicked, [this](bool but)
+	{
+		renderViewport.volumeData->UndoBCTSettings();
+	});
+	
+	QObject::connect(controlPanel.buttonBrightnessContrastReset, &QPushButton::clicked, [this](bool but)
+	{
+		renderViewport.volumeData->ResetBCTSettings();
+	});
+	
 	//central
 	setCentralWidget(&renderViewport);
 
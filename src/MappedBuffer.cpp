@@ -0,0 +1,183 @@
+#include "MappedBuffer.hpp"
+
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#endif
+
+
+MappedBuffer::MappedBuffer()
+{
+	data = NULL;
+	size = 0;
+}
+
+MappedBuffer::~MappedBuffer()
+{
+	Deallocate();
+}
+
+#ifdef _WIN32
+
+bool MappedBuffer::Allocate(uint64_t bytes, std::string directory)
+{
+	Deallocate();
+	if(bytes == 0)
+		return false;
+
+	char path[MAX_PATH];
+	if(GetTempFileNameA(directory.c_str(), "vol", 0, path) == 0)
+	{
+		std::cout << "MappedBuffer: could not create a file in " << directory << std::endl;
+		return false;
+	}
+
+	HANDLE file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "MappedBuffer: could not open " << path << std::endl;
+		DeleteFileA(path);
+		return false;
+	}
+
+	//the view keeps the mapping and the file alive, both handles can go once it exists
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)(bytes & 0xffffffff), NULL);
+	if(mapping != NULL)
+	{
+		data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+		CloseHandle(mapping);
+	}
+	CloseHandle(file);
+
+	if(data == NULL)
+	{
+		std::cout << "MappedBuffer: could not map " << bytes << " bytes" << std::endl;
+		return false;
+	}
+
+	size = bytes;
+	return true;
+}
+
+void MappedBuffer::Deallocate()
+{
+	if(data != NULL)
+		UnmapViewOfFile(data);
+
+	data = NULL;
+	size = 0;
+}
+
+void MappedBuffer::Advise(uint64_t offset, uint64_t length, MAPPED_ADVICE advice)
+{
+	if(data == NULL || offset >= size)
+		return;
+	length = std::min(length, size - offset);
+
+	if(advice == MAPPED_ADVICE_WILLNEED)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range;
+		range.VirtualAddress = (unsigned char*)data + offset;
+		range.NumberOfBytes = length;
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+	//unlocking pages that are not locked takes them out of the working set
+	else if(advice == MAPPED_ADVICE_DONTNEED)
+		VirtualUnlock((unsigned char*)data + offset, length);
+}
+
+#else
+
+bool MappedBuffer::Allocate(uint64_t bytes, std::string directory)
+{
+	Deallocate();
+	if(bytes == 0)
+		return false;
+
+	std::string path = directory + "/VolumetricRendererXXXXXX";
+	std::vector<char> name(path.begin(), path.end());
+	name.push_back(0);
+
+	int fd = mkstemp(name.data());
+	if(fd < 0)
+	{
+		std::cout << "MappedBuffer: could not create a file in " << directory << std::endl;
+		return false;
+	}
+	unlink(name.data());
+
+	//reserve the blocks now, a full disk would otherwise only show up as SIGBUS on first write
+	if(posix_fallocate(fd, 0, bytes) != 0)
+	{
+		std::cout << "MappedBuffer: not enough space for " << bytes << " bytes in " << directory << std::endl;
+		close(fd);
+		return false;
+	}
+
+	void* mapped = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED)
+	{
+		std::cout << "MappedBuffer: could not map " << bytes << " bytes" << std::endl;
+		return false;
+	}
+
+	data = mapped;
+	size = bytes;
+	return true;
+}
+
+void MappedBuffer::Deallocate()
+{
+	if(data != NULL)
+		munmap(data, size);
+
+	data = NULL;
+	size = 0;
+}
+
+void MappedBuffer::Advise(uint64_t offset, uint64_t length, MAPPED_ADVICE advice)
+{
+	if(data == NULL || offset >= size)
+		return;
+
+	//madvise wants page aligned ranges, widen to the enclosing pages
+	uint64_t page = sysconf(_SC_PAGESIZE);
+	uint64_t end = std::min(size, offset + length);
+	offset -= offset % page;
+
+	int flag = MADV_NORMAL;
+	switch(advice)
+	{
+		case MAPPED_ADVICE_SEQUENTIAL: flag = MADV_SEQUENTIAL; break;
+		case MAPPED_ADVICE_RANDOM: flag = MADV_RANDOM; break;
+		case MAPPED_ADVICE_WILLNEED: flag = MADV_WILLNEED; break;
+		case MAPPED_ADVICE_DONTNEED: flag = MADV_DONTNEED; break;
+		default: break;
+	}
+	madvise((unsigned char*)data + offset, end - offset, flag);
+}
+
+#endif
+
+void MappedBuffer::Swap(MappedBuffer& other)
+{
+	std::swap(data, other.data);
+	std::swap(size, other.size);
+}
+
+void* MappedBuffer::Data()
+{
+	return data;
+}
+
+uint64_t MappedBuffer::Size()
+{
+	return size;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+
+#include "Common.hpp"
+
+
+//Access hints for a mapped buffer, they map onto madvise on posix and onto PrefetchVirtualMemory /
+//VirtualUnlock on windows. DONTNEED only drops pages from memory, their contents stay in the file.
+enum MAPPED_ADVICE{MAPPED_ADVICE_NORMAL, MAPPED_ADVICE_SEQUENTIAL, MAPPED_ADVICE_RANDOM, MAPPED_ADVICE_WILLNEED, MAPPED_ADVICE_DONTNEED};
+
+
+//Memory backed by an unnamed temporary file instead of RAM or swap. The OS pages it in on demand and
+//can write it back to the file under memory pressure, so buffers larger than physical memory work.
+//The file is removed as soon as it is mapped (posix) or when the mapping is closed (windows).
+class MappedBuffer
+{
+	protected:
+		void* data;
+		uint64_t size;
+
+	public:
+		MappedBuffer();
+		~MappedBuffer();
+		bool Allocate(uint64_t bytes, std::string directory);
+		void Deallocate();
+		void Swap(MappedBuffer& other);
+		void* Data();
+		uint64_t Size();
+		void Advise(uint64_t offset, uint64_t length, MAPPED_ADVICE advice);
+};
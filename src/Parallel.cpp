@@ -0,0 +1,136 @@
+#include "Parallel.hpp"
+
+#include <atomic>
+#include <stdlib.h>
+
+
+static std::atomic<int> threadCount(-1);
+
+void SetThreadCount(int count)
+{
+	threadCount = count < 0 ? 0 : count;
+}
+
+int GetThreadCount()
+{
+	int count = threadCount;
+
+	//first use, pick up an override from the environment
+	if(count < 0)
+	{
+		count = 0;
+		const char* env = getenv("VOLUMETRIC_RENDERER_THREADS");
+		if(env != NULL)
+			count = atoi(env) > 0 ? atoi(env) : 0;
+		threadCount = count;
+	}
+
+	if(count == 0)
+		count = std::thread::hardware_concurrency();
+
+	return count > 0 ? count : 1;
+}
+
+void ParallelFor(uint64_t begin, uint64_t end, std::function<void(uint64_t, uint64_t)> func)
+{
+	if(end <= begin)
+		return;
+
+	uint64_t range = end - begin;
+	uint64_t chunks = GetThreadCount();
+	if(chunks > range)
+		chunks = range;
+
+	if(chunks <= 1)
+	{
+		func(begin, end);
+		return;
+	}
+
+	//spread the remainder over the first chunks so no thread gets more than one extra item
+	uint64_t chunkSize = range / chunks;
+	uint64_t remainder = range % chunks;
+
+	std::vector<std::thread> workers;
+	uint64_t chunkBegin = begin;
+	for(uint64_t i = 0; i < chunks; i++)
+	{
+		uint64_t chunkEnd = chunkBegin + chunkSize + (i < remainder ? 1 : 0);
+		if(i == chunks - 1)
+			func(chunkBegin, chunkEnd);
+		else
+			workers.push_back(std::thread(func, chunkBegin, chunkEnd));
+		chunkBegin = chunkEnd;
+	}
+
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+WorkerPool::WorkerPool(int threads)
+{
+	pending = 0;
+	stopping = false;
+	
+	if(threads <= 0)
+		threads = GetThreadCount();
+	
+	for(int i = 0; i < threads; i++)
+		workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskReady.notify_all();
+	
+	for(size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+}
+
+int WorkerPool::ThreadCount()
+{
+	return workers.size();
+}
+
+void WorkerPool::Submit(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(task);
+		pending++;
+	}
+	taskReady.notify_one();
+}
+
+void WorkerPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	tasksDone.wait(lock, [this]{ return pending == 0; });
+}
+
+void WorkerPool::WorkerLoop()
+{
+	while(true)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			taskReady.wait(lock, [this]{ return stopping || !tasks.empty(); });
+			if(tasks.empty())
+				return;
+			task = tasks.front();
+			tasks.pop_front();
+		}
+		
+		task();
+		
+		std::lock_guard<std::mutex> lock(mutex);
+		pending--;
+		if(pending == 0)
+			tasksDone.notify_all();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+
+#include "Common.hpp"
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+
+//Number of threads the image kernels split their work over. 0 (the default) uses every hardware
+//thread unless the VOLUMETRIC_RENDERER_THREADS environment variable is set.
+void SetThreadCount(int count);
+int GetThreadCount();
+
+//Split [begin, end) into one contiguous chunk per thread and call func(chunkBegin, chunkEnd) for each
+//chunk. The caller thread runs the last chunk and the call returns when every chunk is done.
+void ParallelFor(uint64_t begin, uint64_t end, std::function<void(uint64_t, uint64_t)> func);
+
+
+//Fixed set of threads that run submitted tasks in submission order. Used where work has to overlap
+//with something the caller does itself, e.g. GL uploads that must stay on the main thread.
+class WorkerPool
+{
+	protected:
+		std::vector<std::thread> workers;
+		std::deque<std::function<void()>> tasks;
+		std::mutex mutex;
+		std::condition_variable taskReady;
+		std::condition_variable tasksDone;
+		uint64_t pending;
+		bool stopping;
+		
+		void WorkerLoop();
+		
+	public:
+		WorkerPool(int threads = 0);//0 uses GetThreadCount()
+		~WorkerPool();
+		int ThreadCount();
+		void Submit(std::function<void()> task);
+		void Wait();//returns once every submitted task has finished
+};
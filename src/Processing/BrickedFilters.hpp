@@ -0,0 +1,153 @@
+#pragma once
+
+
+#include "../BrickedImage3D.hpp"
+#include "NeighbourhoodFilters.hpp"
+
+
+//
+//Brick by brick versions of the neighbourhood filters. Each brick is first gathered together with a one
+//voxel apron into a small (B + 2)^3 cache, the kernel then only reads from that cache. For 16^3 bricks of
+//16 bit voxels the cache is about 11KB, so the whole neighbourhood stays in L1 instead of touching three
+//slices that are width * height voxels apart.
+//
+
+
+template<class T, class Boundary> void GatherBrickApron(const TypedBrickedImage3D<T>& in, int64_t bx, int64_t by, int64_t bz, const TypedImage3D<T>& cache)
+{
+	int64_t b = in.BrickSize();
+	int64_t x0 = bx * b - 1;
+	int64_t y0 = by * b - 1;
+	int64_t z0 = bz * b - 1;
+	bool interior = x0 >= 0 && y0 >= 0 && z0 >= 0 && x0 + b + 2 <= in.width && y0 + b + 2 <= in.height && z0 + b + 2 <= in.depth;
+
+	int64_t mask = b - 1;
+
+	for(int64_t cz = 0; cz < b + 2; cz++)
+	{
+		for(int64_t cy = 0; cy < b + 2; cy++)
+		{
+			T* row = cache.Row(cy, cz);
+			int64_t y = y0 + cy;
+			int64_t z = z0 + cz;
+
+			if(interior)
+			{
+				//the middle of every row lies in a single brick, only the two end voxels come from the x neighbours
+				T* brick = in.Brick(in.BrickId(bx, y >> in.brickShift, z >> in.brickShift));
+				T* src = brick + ((z & mask) * b + (y & mask)) * b;
+				std::copy(src, src + b, row + 1);
+				row[0] = in.At(x0, y, z);
+				row[b + 1] = in.At(x0 + b + 1, y, z);
+			}
+			else
+			{
+				for(int64_t cx = 0; cx < b + 2; cx++)
+					row[cx] = Boundary::Fetch(in, x0 + cx, y, z);
+			}
+		}
+	}
+}
+
+//Filters row y, z of the brick, cache coordinates are offset by the one voxel apron
+template<class T, int zRadius> struct BrickMeanRow
+{
+	static inline void Run(const TypedImage3D<T>& cache, T* outRow, int64_t y, int64_t z, int64_t xEnd)
+	{
+		typedef typename PixelTypeTraits<T>::Sum Sum;
+		const int count = 9 * (2 * zRadius + 1);
+
+		T* rows[9];
+		int n = 0;
+		for(int64_t dz = -zRadius; dz <= zRadius; dz++)
+			for(int64_t dy = -1; dy <= 1; dy++)
+				rows[n++] = cache.Row(y + 1 + dy, z + 1 + dz) + 1;
+
+		for(int64_t x = 0; x < xEnd; x++)
+		{
+			Sum running = 0;
+			for(int i = 0; i < n; i++)
+				running += (Sum)rows[i][x - 1] + (Sum)rows[i][x] + (Sum)rows[i][x + 1];
+			outRow[x] = running / count;
+		}
+	}
+};
+
+template<class T, int zRadius> struct BrickMedianRow
+{
+	static inline void Run(const TypedImage3D<T>& cache, T* outRow, int64_t y, int64_t z, int64_t xEnd)
+	{
+		T vals[27];
+		for(int64_t x = 0; x < xEnd; x++)
+		{
+			int n = GatherNeighbourhood<T, BoundaryClamp, zRadius>(cache, x + 1, y + 1, z + 1, true, vals);
+			std::nth_element(vals, vals + n / 2, vals + n);
+			outRow[x] = vals[n / 2];
+		}
+	}
+};
+
+//Runs RowOp over the bricks stored in slots [slotBegin, slotEnd), voxels past the volume edge are skipped
+template<class T, class Boundary, class RowOp> void BrickedFilterSlots(const TypedBrickedImage3D<T>& in, const TypedBrickedImage3D<T>& out, int64_t slotBegin, int64_t slotEnd)
+{
+	int64_t b = in.BrickSize();
+	std::vector<T> cacheData((b + 2) * (b + 2) * (b + 2));
+	TypedImage3D<T> cache(cacheData.data(), b + 2, b + 2, b + 2);
+
+	for(int64_t slot = slotBegin; slot < slotEnd; slot++)
+	{
+		int64_t id = in.brickOrder[slot];
+		int64_t bx = id % in.bricksX;
+		int64_t by = (id / in.bricksX) % in.bricksY;
+		int64_t bz = id / (in.bricksX * in.bricksY);
+
+		GatherBrickApron<T, Boundary>(in, bx, by, bz, cache);
+
+		T* outBrick = out.Brick(id);
+		int64_t xEnd = std::min(b, in.width - bx * b);
+		int64_t yEnd = std::min(b, in.height - by * b);
+		int64_t zEnd = std::min(b, in.depth - bz * b);
+
+		for(int64_t z = 0; z < zEnd; z++)
+			for(int64_t y = 0; y < yEnd; y++)
+				RowOp::Run(cache, outBrick + (z * b + y) * b, y, z, xEnd);
+	}
+}
+
+
+//
+//Kernel entry points, same shape as the linear ones but Run takes a range of brick slots
+//
+
+
+template<class T, class Boundary> struct BrickedSmooth2DKernel
+{
+	static void Run(const TypedBrickedImage3D<T>& in, const TypedBrickedImage3D<T>& out, int64_t slotBegin, int64_t slotEnd)
+	{
+		BrickedFilterSlots<T, Boundary, BrickMeanRow<T, 0> >(in, out, slotBegin, slotEnd);
+	}
+};
+
+template<class T, class Boundary> struct BrickedSmoothKernel
+{
+	static void Run(const TypedBrickedImage3D<T>& in, const TypedBrickedImage3D<T>& out, int64_t slotBegin, int64_t slotEnd)
+	{
+		BrickedFilterSlots<T, Boundary, BrickMeanRow<T, 1> >(in, out, slotBegin, slotEnd);
+	}
+};
+
+template<class T, class Boundary> struct BrickedMedian2DKernel
+{
+	static void Run(const TypedBrickedImage3D<T>& in, const TypedBrickedImage3D<T>& out, int64_t slotBegin, int64_t slotEnd)
+	{
+		BrickedFilterSlots<T, Boundary, BrickMedianRow<T, 0> >(in, out, slotBegin, slotEnd);
+	}
+};
+
+template<class T, class Boundary> struct BrickedMedianKernel
+{
+	static void Run(const TypedBrickedImage3D<T>& in, const TypedBrickedImage3D<T>& out, int64_t slotBegin, int64_t slotEnd)
+	{
+		BrickedFilterSlots<T, Boundary, BrickMedianRow<T, 1> >(in, out, slotBegin, slotEnd);
+	}
+};
@@ -0,0 +1,332 @@
+#include "ConnectedComponents.hpp"
+
+
+#include "../Parallel.hpp"
+
+#include <unordered_map>
+
+
+//While labelling, entry i holds its parent voxel index + 1 so 0 can stay the background
+static inline uint32_t FindRoot(uint32_t* labels, uint32_t i)
+{
+	//path halving, every visited entry skips to its grandparent
+	while(labels[i] - 1 != i)
+	{
+		uint32_t grandParent = labels[labels[i] - 1] - 1;
+		labels[i] = grandParent + 1;
+		i = grandParent;
+	}
+	return i;
+}
+
+static inline void Union(uint32_t* labels, uint32_t a, uint32_t b)
+{
+	a = FindRoot(labels, a);
+	b = FindRoot(labels, b);
+	if(a < b)
+		labels[b] = a + 1;
+	else if(b < a)
+		labels[a] = b + 1;
+}
+
+struct NeighbourOffset
+{
+	int dx;
+	int dy;
+	int dz;
+	int64_t linear;
+	bool alsoLeft;//also a neighbour of the voxel to the left, which is in its component already
+};
+
+//Neighbours that come earlier in z, y, x scan order, they are labelled by the time a voxel is reached
+static int BackwardOffsets(CONNECTIVITY connectivity, int64_t W, int64_t H, NeighbourOffset offsets[13])
+{
+	int maxAxes = connectivity == CONNECTIVITY_6 ? 1 : (connectivity == CONNECTIVITY_18 ? 2 : 3);
+	int count = 0;
+	for(int dz = -1; dz <= 0; dz++)
+	{
+		for(int dy = -1; dy <= 1; dy++)
+		{
+			for(int dx = -1; dx <= 1; dx++)
+			{
+				bool earlier = dz < 0 || (dz == 0 && (dy < 0 || (dy == 0 && dx < 0)));
+				int axes = (dx != 0) + (dy != 0) + (dz != 0);
+				if(!earlier || axes > maxAxes)
+					continue;
+				int leftAxes = (dx + 1 != 0) + (dy != 0) + (dz != 0);
+				offsets[count].dx = dx;
+				offsets[count].dy = dy;
+				offsets[count].dz = dz;
+				offsets[count].linear = (dz * H + dy) * W + dx;
+				offsets[count].alsoLeft = dx <= 0 && (dy != 0 || dz != 0) && leftAxes <= maxAxes;
+				count++;
+			}
+		}
+	}
+	return count;
+}
+
+struct ComponentSlab
+{
+	int64_t zBegin;
+	int64_t zEnd;
+	std::vector<uint32_t> roots;//voxels that are roots within the slab, ascending
+	std::vector<uint32_t> rootLabels;//final label of every root
+	uint32_t firstLabel;//labels of the components whose overall root lies in this slab are consecutive
+	uint32_t labelCount;
+};
+
+static inline void AddVoxel(ComponentInfo& info, uint64_t x, uint64_t y, uint64_t z)
+{
+	if(info.voxels == 0)
+	{
+		info.minX = info.maxX = x;
+		info.minY = info.maxY = y;
+		info.minZ = info.maxZ = z;
+	}
+	info.voxels++;
+	info.minX = std::min(info.minX, x);
+	info.minY = std::min(info.minY, y);
+	info.minZ = std::min(info.minZ, z);
+	info.maxX = std::max(info.maxX, x);
+	info.maxY = std::max(info.maxY, y);
+	info.maxZ = std::max(info.maxZ, z);
+}
+
+static inline void MergeInfo(ComponentInfo& info, ComponentInfo& other)
+{
+	if(other.voxels == 0)
+		return;
+	if(info.voxels == 0)
+	{
+		info = other;
+		return;
+	}
+	info.voxels += other.voxels;
+	info.minX = std::min(info.minX, other.minX);
+	info.minY = std::min(info.minY, other.minY);
+	info.minZ = std::min(info.minZ, other.minZ);
+	info.maxX = std::max(info.maxX, other.maxX);
+	info.maxY = std::max(info.maxY, other.maxY);
+	info.maxZ = std::max(info.maxZ, other.maxZ);
+}
+
+uint32_t LabelComponents(uint32_t* labels, int64_t W, int64_t H, int64_t D, CONNECTIVITY connectivity, std::vector<ComponentInfo>* components)
+{
+	components->clear();
+	if(W * H * D >= (int64_t)0xffffffff)
+	{
+		std::cout << "LabelComponents: volumes are limited to 2^32 - 1 voxels" << std::endl;
+		return 0;
+	}
+	if(W * H * D == 0)
+		return 0;
+
+	NeighbourOffset offsets[13];
+	int offsetCount = BackwardOffsets(connectivity, W, H, offsets);
+
+	//neighbours left to check when the voxel to the left is foreground, the left voxel itself is not one
+	NeighbourOffset leftOffsets[13];
+	int leftOffsetCount = 0;
+	for(int k = 0; k < offsetCount; k++)
+		if(!offsets[k].alsoLeft && (offsets[k].dy != 0 || offsets[k].dz != 0))
+			leftOffsets[leftOffsetCount++] = offsets[k];
+
+	std::vector<ComponentSlab> slabs(std::min<int64_t>(D, GetThreadCount()));
+	for(size_t s = 0; s < slabs.size(); s++)
+	{
+		slabs[s].zBegin = D * s / slabs.size();
+		slabs[s].zEnd = D * (s + 1) / slabs.size();
+	}
+
+	//union-find inside every slab, then point every voxel straight at its slab root
+	ParallelFor(0, slabs.size(), [&](uint64_t sBegin, uint64_t sEnd)
+	{
+		for(uint64_t s = sBegin; s < sEnd; s++)
+		{
+			ComponentSlab& slab = slabs[s];
+			for(int64_t z = slab.zBegin; z < slab.zEnd; z++)
+			{
+				for(int64_t y = 0; y < H; y++)
+				{
+					uint32_t i = (z * H + y) * W;
+					uint32_t leftRoot = 0;
+					for(int64_t x = 0; x < W; x++, i++)
+					{
+						if(labels[i] == 0)
+							continue;
+
+						//nothing links to the new voxel yet, so its root is tracked here instead of searched. A
+						//foreground left voxel passes on its root and the neighbours it shares with this one.
+						uint32_t root;
+						NeighbourOffset* check;
+						int checkCount;
+						if(x > 0 && labels[i - 1] != 0)
+						{
+							root = leftRoot;
+							check = leftOffsets;
+							checkCount = leftOffsetCount;
+						}
+						else
+						{
+							root = i;
+							check = offsets;
+							checkCount = offsetCount;
+						}
+						labels[i] = root + 1;
+
+						for(int k = 0; k < checkCount; k++)
+						{
+							int64_t nx = x + check[k].dx;
+							int64_t ny = y + check[k].dy;
+							int64_t nz = z + check[k].dz;
+							if(nx < 0 || nx >= W || ny < 0 || ny >= H || nz < slab.zBegin)
+								continue;
+							uint32_t n = i + check[k].linear;
+							if(labels[n] == 0)
+								continue;
+							uint32_t other = FindRoot(labels, n);
+							if(other < root)
+							{
+								labels[root] = other + 1;
+								root = other;
+							}
+							else if(root < other)
+								labels[other] = root + 1;
+						}
+						leftRoot = root;
+					}
+				}
+			}
+
+			//parents come before their children, so in scan order the parent is already flattened
+			uint32_t end = slab.zEnd * H * W;
+			for(uint32_t i = slab.zBegin * H * W; i < end; i++)
+			{
+				if(labels[i] == 0)
+					continue;
+				if(labels[i] - 1 == i)
+					slab.roots.push_back(i);
+				else
+					labels[i] = labels[labels[i] - 1];
+			}
+		}
+	});
+
+	//join the slabs, starting from the slab roots keeps every other voxel pointing at its slab root
+	for(size_t s = 1; s < slabs.size(); s++)
+	{
+		int64_t z = slabs[s].zBegin;
+		for(int64_t y = 0; y < H; y++)
+		{
+			uint32_t i = (z * H + y) * W;
+			for(int64_t x = 0; x < W; x++, i++)
+			{
+				if(labels[i] == 0)
+					continue;
+				for(int k = 0; k < offsetCount; k++)
+				{
+					int64_t nx = x + offsets[k].dx;
+					int64_t ny = y + offsets[k].dy;
+					if(offsets[k].dz == 0 || nx < 0 || nx >= W || ny < 0 || ny >= H)
+						continue;
+					uint32_t n = i + offsets[k].linear;
+					if(labels[n] != 0)
+						Union(labels, labels[i] - 1, labels[n] - 1);
+				}
+			}
+		}
+	}
+
+	//number the overall roots in index order, any other slab root takes the label of its overall root
+	auto SlabRootLabel = [&](uint32_t root)
+	{
+		int64_t z = root / (W * H);
+		size_t s = 0;
+		while(slabs[s].zEnd <= z)
+			s++;
+		std::vector<uint32_t>& roots = slabs[s].roots;
+		return slabs[s].rootLabels[std::lower_bound(roots.begin(), roots.end(), root) - roots.begin()];
+	};
+
+	uint32_t labelCount = 0;
+	for(size_t s = 0; s < slabs.size(); s++)
+	{
+		ComponentSlab& slab = slabs[s];
+		slab.rootLabels.resize(slab.roots.size());
+		slab.firstLabel = labelCount + 1;
+		for(size_t k = 0; k < slab.roots.size(); k++)
+		{
+			uint32_t root = slab.roots[k];
+			uint32_t parent = labels[root] - 1;
+			if(parent == root)
+				slab.rootLabels[k] = ++labelCount;
+			else
+			{
+				//the parent was handled before and already points at the overall root
+				uint32_t overallRoot = labels[parent] - 1;
+				labels[root] = overallRoot + 1;
+				slab.rootLabels[k] = SlabRootLabel(overallRoot);
+			}
+		}
+		slab.labelCount = labelCount + 1 - slab.firstLabel;
+	}
+
+	//final labels and statistics, slab roots come first in scan order so their label is in place
+	//before any other voxel of the slab reads it
+	std::vector<std::vector<ComponentInfo>> slabInfos(slabs.size());
+	std::vector<std::unordered_map<uint32_t, ComponentInfo>> slabOtherInfos(slabs.size());
+	ParallelFor(0, slabs.size(), [&](uint64_t sBegin, uint64_t sEnd)
+	{
+		for(uint64_t s = sBegin; s < sEnd; s++)
+		{
+			ComponentSlab& slab = slabs[s];
+			std::vector<ComponentInfo>& infos = slabInfos[s];
+			std::unordered_map<uint32_t, ComponentInfo>& otherInfos = slabOtherInfos[s];
+			ComponentInfo empty = {0, 0, 0, 0, 0, 0, 0};
+			infos.assign(slab.labelCount, empty);
+
+			size_t nextRoot = 0;
+			for(int64_t z = slab.zBegin; z < slab.zEnd; z++)
+			{
+				for(int64_t y = 0; y < H; y++)
+				{
+					uint32_t i = (z * H + y) * W;
+					for(int64_t x = 0; x < W; x++, i++)
+					{
+						if(labels[i] == 0)
+							continue;
+
+						uint32_t label;
+						if(nextRoot < slab.roots.size() && slab.roots[nextRoot] == i)
+							label = slab.rootLabels[nextRoot++];
+						else
+							label = labels[labels[i] - 1];
+						labels[i] = label;
+
+						if(label >= slab.firstLabel && label - slab.firstLabel < slab.labelCount)
+							AddVoxel(infos[label - slab.firstLabel], x, y, z);
+						else
+						{
+							auto entry = otherInfos.find(label);
+							if(entry == otherInfos.end())
+								entry = otherInfos.insert(std::make_pair(label, empty)).first;
+							AddVoxel(entry->second, x, y, z);
+						}
+					}
+				}
+			}
+		}
+	});
+
+	ComponentInfo empty = {0, 0, 0, 0, 0, 0, 0};
+	components->assign(labelCount, empty);
+	for(size_t s = 0; s < slabs.size(); s++)
+	{
+		std::copy(slabInfos[s].begin(), slabInfos[s].end(), components->begin() + (slabs[s].firstLabel - 1));
+		for(auto& entry : slabOtherInfos[s])
+			MergeInfo((*components)[entry.first - 1], entry.second);
+	}
+
+	return labelCount;
+}
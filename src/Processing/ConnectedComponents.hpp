@@ -0,0 +1,32 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//Which neighbours join a voxel to a component: faces (6), faces and edges (18) or all of them (26)
+enum CONNECTIVITY{CONNECTIVITY_6, CONNECTIVITY_18, CONNECTIVITY_26};
+
+//Size and inclusive bounding box of one component
+struct ComponentInfo
+{
+	uint64_t voxels;
+	uint64_t minX;
+	uint64_t minY;
+	uint64_t minZ;
+	uint64_t maxX;
+	uint64_t maxY;
+	uint64_t maxZ;
+};
+
+
+//Labels the components of the nonzero entries of a W x H x D volume in place. Afterwards every
+//foreground entry holds its component label 1 to n and background stays 0, components[label - 1]
+//describes the component. Returns n.
+//
+//The volume is cut into one z slab per thread. Every slab runs union-find over its own voxels with
+//voxel indices as parents, always linking to the smaller root so a parent never comes after its child,
+//and is flattened in one pass. A serial merge joins the slabs across their boundary planes, the roots
+//get consecutive labels in index order and each slab writes its labels and statistics in parallel.
+//Voxel indices must fit in 32 bits.
+uint32_t LabelComponents(uint32_t* labels, int64_t W, int64_t H, int64_t D, CONNECTIVITY connectivity, std::vector<ComponentInfo>* components);
@@ -0,0 +1,120 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//Filters used when halving a volume. BOX averages the 2x2x2 block under the output voxel, GAUSSIAN
+//uses the 4 tap binomial (1 3 3 1) / 8 per axis which is centred on the same point but suppresses
+//more aliasing.
+enum DOWNSAMPLE_FILTER{DOWNSAMPLE_BOX, DOWNSAMPLE_GAUSSIAN};
+
+
+//
+//2x downsampling of interleaved multi channel volumes. Output voxel x covers input voxels 2x and 2x+1,
+//inputs past the edge (odd sizes and the outer binomial taps) are clamped. Sums are kept in integers
+//for the 8 and 16 bit types and rounded to nearest, so repeated halving does not drift darker.
+//
+
+
+template<class T> struct DownsampleTraits
+{
+	typedef int64_t Sum;
+	static inline T Round(Sum sum, Sum weight) { return (T)((sum + weight / 2) / weight); }
+};
+
+template<> struct DownsampleTraits<int16_t>
+{
+	typedef int64_t Sum;
+	static inline int16_t Round(Sum sum, Sum weight) { return (int16_t)(sum >= 0 ? (sum + weight / 2) / weight : -((-sum + weight / 2) / weight)); }
+};
+
+template<> struct DownsampleTraits<float>
+{
+	typedef double Sum;
+	static inline float Round(Sum sum, Sum weight) { return (float)(sum / weight); }
+};
+
+//Input coordinates and weights along one axis for output coordinate o
+inline int DownsampleTaps(int64_t o, int64_t n, DOWNSAMPLE_FILTER filter, int64_t* index, int* weight)
+{
+	if(filter == DOWNSAMPLE_BOX)
+	{
+		index[0] = std::min(2 * o, n - 1);
+		index[1] = std::min(2 * o + 1, n - 1);
+		weight[0] = 1;
+		weight[1] = 1;
+		return 2;
+	}
+
+	const int binomial[4] = {1, 3, 3, 1};
+	for(int i = 0; i < 4; i++)
+	{
+		index[i] = std::max<int64_t>(0, std::min(2 * o - 1 + i, n - 1));
+		weight[i] = binomial[i];
+	}
+	return 4;
+}
+
+//Output slices [zBegin, zEnd) of the half size volume, in is W x H x D with channels values per voxel
+template<class T> void DownsampleSlab(const T* in, T* out, int64_t W, int64_t H, int64_t D, int channels, DOWNSAMPLE_FILTER filter, int64_t zBegin, int64_t zEnd)
+{
+	typedef typename DownsampleTraits<T>::Sum Sum;
+
+	int64_t outW = (W + 1) / 2;
+	int64_t outH = (H + 1) / 2;
+
+	//the x taps are the same for every row
+	std::vector<int64_t> xIndex(outW * 4);
+	std::vector<int> xWeight(outW * 4);
+	int xTaps = 0;
+	for(int64_t x = 0; x < outW; x++)
+		xTaps = DownsampleTaps(x, W, filter, &xIndex[x * 4], &xWeight[x * 4]);
+
+	std::vector<Sum> rowSum(W * channels);
+
+	for(int64_t z = zBegin; z < zEnd; z++)
+	{
+		int64_t zIndex[4];
+		int zWeight[4];
+		int zTaps = DownsampleTaps(z, D, filter, zIndex, zWeight);
+
+		for(int64_t y = 0; y < outH; y++)
+		{
+			int64_t yIndex[4];
+			int yWeight[4];
+			int yTaps = DownsampleTaps(y, H, filter, yIndex, yWeight);
+
+			//collapse the y and z taps into one weighted input row, then filter that row along x
+			std::fill(rowSum.begin(), rowSum.end(), 0);
+			Sum weight = 0;
+			for(int k = 0; k < zTaps; k++)
+			{
+				for(int j = 0; j < yTaps; j++)
+				{
+					const T* row = in + ((zIndex[k] * H + yIndex[j]) * W) * channels;
+					int w = zWeight[k] * yWeight[j];
+					for(int64_t i = 0; i < W * channels; i++)
+						rowSum[i] += (Sum)row[i] * w;
+					weight += w;
+				}
+			}
+
+			T* outRow = out + ((z * outH + y) * outW) * channels;
+			for(int64_t x = 0; x < outW; x++)
+			{
+				for(int c = 0; c < channels; c++)
+				{
+					Sum sum = 0;
+					Sum xWeightSum = 0;
+					for(int i = 0; i < xTaps; i++)
+					{
+						sum += rowSum[xIndex[x * 4 + i] * channels + c] * xWeight[x * 4 + i];
+						xWeightSum += xWeight[x * 4 + i];
+					}
+					outRow[x * channels + c] = DownsampleTraits<T>::Round(sum, weight * xWeightSum);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,63 @@
+#include "LookupTable.hpp"
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+#if defined(__AVX2__)
+
+//8 voxels per iteration, the table entries are gathered as 32 bit words and the upper half masked off
+static inline __m256i GatherLookup(const uint16_t* lut, __m256i idx)
+{
+	return _mm256_and_si256(_mm256_i32gather_epi32((const int*)lut, idx, 2), _mm256_set1_epi32(0xffff));
+}
+
+static uint64_t ApplyLookupTableSIMD(uint8_t* in, uint8_t* out, const uint16_t* lut, uint64_t begin, uint64_t end)
+{
+	uint64_t i = begin;
+	for(; i + 8 <= end; i += 8)
+	{
+		__m256i v = GatherLookup(lut, _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)(in + i))));
+		__m128i w = _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+		_mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(w, w));
+	}
+	return i;
+}
+
+static uint64_t ApplyLookupTableSIMD(uint16_t* in, uint16_t* out, const uint16_t* lut, uint64_t begin, uint64_t end)
+{
+	uint64_t i = begin;
+	for(; i + 8 <= end; i += 8)
+	{
+		__m256i v = GatherLookup(lut, _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)(in + i))));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1)));
+	}
+	return i;
+}
+
+#else
+
+template<class T> static uint64_t ApplyLookupTableSIMD(T* in, T* out, const uint16_t* lut, uint64_t begin, uint64_t end)
+{
+	return begin;
+}
+
+#endif
+
+
+template<class T> static void ApplyLookupTableTyped(T* in, T* out, const uint16_t* lut, uint64_t begin, uint64_t end)
+{
+	uint64_t i = ApplyLookupTableSIMD(in, out, lut, begin, end);
+	for(; i < end; i++)
+		out[i] = lut[in[i]];
+}
+
+void ApplyLookupTableRange(void* in, void* out, int pixelSize, const uint16_t* lut, uint64_t begin, uint64_t end)
+{
+	if(pixelSize == 1)//8 bit monochrome images
+		ApplyLookupTableTyped((uint8_t*)in, (uint8_t*)out, lut, begin, end);
+	else if(pixelSize == 2)//16 bit monochrome images
+		ApplyLookupTableTyped((uint16_t*)in, (uint16_t*)out, lut, begin, end);
+}
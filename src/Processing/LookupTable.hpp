@@ -0,0 +1,10 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//out[i] = lut[in[i]] for the voxels [begin, end) of a single channel 8 (pixelSize 1) or 16 (pixelSize 2)
+//bit volume. lut holds one entry per input value plus one padding entry so the vector gathers may read
+//a whole 32 bit word at the last index. in and out may be the same buffer.
+void ApplyLookupTableRange(void* in, void* out, int pixelSize, const uint16_t* lut, uint64_t begin, uint64_t end);
@@ -0,0 +1,114 @@
+#include "MinMax.hpp"
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+//
+//Lane wrappers in the style of SobelGradient.cpp, unsigned min/max over 32 (AVX2) or 16 (SSE4.1) bytes
+//
+
+#if defined(__AVX2__)
+
+struct MinMaxLanes
+{
+	typedef __m256i V;
+	static const int bytes = 32;
+	static inline V Load(const void* p) { return _mm256_loadu_si256((const V*)p); }
+	static inline V Min(V a, V b, uint8_t*) { return _mm256_min_epu8(a, b); }
+	static inline V Max(V a, V b, uint8_t*) { return _mm256_max_epu8(a, b); }
+	static inline V Min(V a, V b, uint16_t*) { return _mm256_min_epu16(a, b); }
+	static inline V Max(V a, V b, uint16_t*) { return _mm256_max_epu16(a, b); }
+	static inline void Store(void* p, V a) { _mm256_storeu_si256((V*)p, a); }
+};
+
+#else
+
+struct MinMaxLanes
+{
+	typedef __m128i V;
+	static const int bytes = 16;
+	static inline V Load(const void* p) { return _mm_loadu_si128((const V*)p); }
+	static inline V Min(V a, V b, uint8_t*) { return _mm_min_epu8(a, b); }
+	static inline V Max(V a, V b, uint8_t*) { return _mm_max_epu8(a, b); }
+	static inline V Min(V a, V b, uint16_t*) { return _mm_min_epu16(a, b); }
+	static inline V Max(V a, V b, uint16_t*) { return _mm_max_epu16(a, b); }
+	static inline void Store(void* p, V a) { _mm_storeu_si128((V*)p, a); }
+};
+
+#endif
+
+//Reduces whole vectors starting at begin, returns the first voxel that was not visited
+template<class T> static uint64_t MinMaxSIMD(T* in, uint64_t begin, uint64_t end, T* minValue, T* maxValue)
+{
+	typedef MinMaxLanes L;
+	typedef typename L::V V;
+	const uint64_t count = L::bytes / sizeof(T);
+
+	if(end - begin < count)
+		return begin;
+
+	V vMin = L::Load(in + begin);
+	V vMax = vMin;
+	uint64_t i = begin + count;
+	for(; i + count <= end; i += count)
+	{
+		V v = L::Load(in + i);
+		vMin = L::Min(vMin, v, (T*)NULL);
+		vMax = L::Max(vMax, v, (T*)NULL);
+	}
+
+	T lanesMin[count];
+	T lanesMax[count];
+	L::Store(lanesMin, vMin);
+	L::Store(lanesMax, vMax);
+	for(uint64_t j = 0; j < count; j++)
+	{
+		*minValue = std::min(*minValue, lanesMin[j]);
+		*maxValue = std::max(*maxValue, lanesMax[j]);
+	}
+
+	return i;
+}
+
+#else
+
+template<class T> static uint64_t MinMaxSIMD(T* in, uint64_t begin, uint64_t end, T* minValue, T* maxValue)
+{
+	return begin;
+}
+
+#endif
+
+
+template<class T> static void MinMaxTyped(T* in, uint64_t begin, uint64_t end, uint64_t* minValue, uint64_t* maxValue)
+{
+	if(end <= begin)
+		return;
+
+	T minD = in[begin];
+	T maxD = in[begin];
+	uint64_t i = MinMaxSIMD(in, begin, end, &minD, &maxD);
+	for(; i < end; i++)
+	{
+		minD = std::min(minD, in[i]);
+		maxD = std::max(maxD, in[i]);
+	}
+
+	*minValue = minD;
+	*maxValue = maxD;
+}
+
+void MinMaxRange(void* in, int pixelSize, uint64_t begin, uint64_t end, uint64_t* minValue, uint64_t* maxValue)
+{
+	if(pixelSize == 1)//8 bit monochrome images
+		MinMaxTyped((uint8_t*)in, begin, end, minValue, maxValue);
+	else if(pixelSize == 2)//16 bit monochrome images
+		MinMaxTyped((uint16_t*)in, begin, end, minValue, maxValue);
+}
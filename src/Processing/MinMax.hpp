@@ -0,0 +1,9 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//Smallest and largest value of the voxels [begin, end) of a single channel 8 (pixelSize 1) or 16
+//(pixelSize 2) bit volume. Leaves minValue and maxValue untouched when the range is empty.
+void MinMaxRange(void* in, int pixelSize, uint64_t begin, uint64_t end, uint64_t* minValue, uint64_t* maxValue);
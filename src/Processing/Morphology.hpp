@@ -0,0 +1,139 @@
+#pragma once
+
+
+#include "../TypedImage3D.hpp"
+
+#include <limits>
+
+
+//
+//Grey value erosion and dilation with a box of 2r + 1 voxels per axis. The box is separable, so the
+//filter runs as one min or max pass along each axis. Every pass uses van Herk / Gil-Werman: the line
+//is cut into blocks of 2r + 1 values, a running max (min) from the start and from the end of every
+//block is kept, and any window covers the tail of one block and the head of the next, so each output
+//takes three comparisons no matter what the radius is.
+//
+//A pass moves whole rows at a time, a line element is span contiguous values that are combined
+//element wise. Along y and z that keeps the inner loops running over x.
+//
+
+
+template<class T> struct MorphologyMax
+{
+	static inline T Apply(T a, T b) { return a > b ? a : b; }
+	static inline T Identity() { return std::numeric_limits<T>::lowest(); }
+};
+
+template<class T> struct MorphologyMin
+{
+	static inline T Apply(T a, T b) { return a < b ? a : b; }
+	static inline T Identity() { return std::numeric_limits<T>::max(); }
+};
+
+//Scratch lines of one worker, sized for the longest line it filters
+template<class T> struct MorphologyScratch
+{
+	std::vector<T> padded;
+	std::vector<T> forward;
+	std::vector<T> backward;
+};
+
+//Filters the n elements at line, line + stride, ... in place. Outside the line the values are pad,
+//the identity of Op leaves the window to the voxels inside the volume.
+template<class T, class Op> void MorphologyLine(T* line, int64_t n, int64_t stride, int64_t span, int radius, T pad, MorphologyScratch<T>& scratch)
+{
+	int64_t k = 2 * radius + 1;
+	int64_t m = ((n + 2 * radius + k - 1) / k) * k;
+	scratch.padded.resize(m * span);
+	scratch.forward.resize(m * span);
+	scratch.backward.resize(m * span);
+	T* p = scratch.padded.data();
+	T* g = scratch.forward.data();
+	T* h = scratch.backward.data();
+
+	std::fill(p, p + radius * span, pad);
+	for(int64_t i = 0; i < n; i++)
+		std::copy(line + i * stride, line + i * stride + span, p + (i + radius) * span);
+	std::fill(p + (n + radius) * span, p + m * span, pad);
+
+	for(int64_t b = 0; b < m; b += k)
+	{
+		std::copy(p + b * span, p + (b + 1) * span, g + b * span);
+		for(int64_t j = b + 1; j < b + k; j++)
+			for(int64_t s = 0; s < span; s++)
+				g[j * span + s] = Op::Apply(g[(j - 1) * span + s], p[j * span + s]);
+
+		std::copy(p + (b + k - 1) * span, p + (b + k) * span, h + (b + k - 1) * span);
+		for(int64_t j = b + k - 2; j >= b; j--)
+			for(int64_t s = 0; s < span; s++)
+				h[j * span + s] = Op::Apply(h[(j + 1) * span + s], p[j * span + s]);
+	}
+
+	//output i sees padded [i, i + 2r], the backward run from i and the forward run up to i + 2r
+	for(int64_t i = 0; i < n; i++)
+	{
+		T* out = line + i * stride;
+		for(int64_t s = 0; s < span; s++)
+			out[s] = Op::Apply(h[i * span + s], g[(i + 2 * radius) * span + s]);
+	}
+}
+
+//Single contiguous line from in to out, the x pass. Same as MorphologyLine with span 1 but without the
+//per element loops, which cost more than the comparisons themselves.
+template<class T, class Op> void MorphologyRow(const T* in, T* out, int64_t n, int radius, T pad, MorphologyScratch<T>& scratch)
+{
+	int64_t k = 2 * radius + 1;
+	int64_t m = ((n + 2 * radius + k - 1) / k) * k;
+	scratch.padded.resize(m);
+	scratch.forward.resize(m);
+	scratch.backward.resize(m);
+	T* p = scratch.padded.data();
+	T* g = scratch.forward.data();
+	T* h = scratch.backward.data();
+
+	std::fill(p, p + radius, pad);
+	std::copy(in, in + n, p + radius);
+	std::fill(p + n + radius, p + m, pad);
+
+	for(int64_t b = 0; b < m; b += k)
+	{
+		g[b] = p[b];
+		for(int64_t j = b + 1; j < b + k; j++)
+			g[j] = Op::Apply(g[j - 1], p[j]);
+
+		h[b + k - 1] = p[b + k - 1];
+		for(int64_t j = b + k - 2; j >= b; j--)
+			h[j] = Op::Apply(h[j + 1], p[j]);
+	}
+
+	const T* gEnd = g + 2 * radius;
+	for(int64_t i = 0; i < n; i++)
+		out[i] = Op::Apply(h[i], gEnd[i]);
+}
+
+//x pass over slices [zBegin, zEnd) from in to out
+template<class T, class Op> void MorphologyPassX(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int radius, T pad, int64_t zBegin, int64_t zEnd)
+{
+	MorphologyScratch<T> scratch;
+	for(int64_t z = zBegin; z < zEnd; z++)
+	{
+		for(int64_t y = 0; y < in.height; y++)
+			MorphologyRow<T, Op>(in.Row(y, z), out.Row(y, z), in.width, radius, pad, scratch);
+	}
+}
+
+//y pass over slices [zBegin, zEnd), in place
+template<class T, class Op> void MorphologyPassY(const TypedImage3D<T>& img, int radius, T pad, int64_t zBegin, int64_t zEnd)
+{
+	MorphologyScratch<T> scratch;
+	for(int64_t z = zBegin; z < zEnd; z++)
+		MorphologyLine<T, Op>(img.Row(0, z), img.height, img.rowStride, img.width, radius, pad, scratch);
+}
+
+//z pass over rows [yBegin, yEnd), in place
+template<class T, class Op> void MorphologyPassZ(const TypedImage3D<T>& img, int radius, T pad, int64_t yBegin, int64_t yEnd)
+{
+	MorphologyScratch<T> scratch;
+	for(int64_t y = yBegin; y < yEnd; y++)
+		MorphologyLine<T, Op>(img.Row(y, 0), img.depth, img.sliceStride, img.width, radius, pad, scratch);
+}
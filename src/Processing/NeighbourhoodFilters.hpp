@@ -0,0 +1,151 @@
+#pragma once
+
+
+#include "../TypedImage3D.hpp"
+
+
+//
+//3x3 (zRadius 0) and 3x3x3 (zRadius 1) neighbourhood filters. They read from in and write to out so
+//the result does not depend on scan order or how the z range is split between threads. Rows whose
+//whole neighbourhood is inside the volume run a branch free loop over the interior voxels, only the
+//remaining border voxels go through Boundary::Fetch.
+//
+
+
+template<class T, class Boundary, int zRadius> inline int GatherNeighbourhood(const TypedImage3D<T>& in, int64_t x, int64_t y, int64_t z, bool interior, T* vals)
+{
+	int n = 0;
+	for(int64_t dz = -zRadius; dz <= zRadius; dz++)
+	{
+		for(int64_t dy = -1; dy <= 1; dy++)
+		{
+			if(interior)
+			{
+				T* row = in.Row(y + dy, z + dz);
+				vals[n++] = row[x - 1];
+				vals[n++] = row[x];
+				vals[n++] = row[x + 1];
+			}
+			else
+			{
+				vals[n++] = Boundary::Fetch(in, x - 1, y + dy, z + dz);
+				vals[n++] = Boundary::Fetch(in, x, y + dy, z + dz);
+				vals[n++] = Boundary::Fetch(in, x + 1, y + dy, z + dz);
+			}
+		}
+	}
+	return n;
+}
+
+template<class T, class Boundary, int zRadius> inline T BoxMeanVoxel(const TypedImage3D<T>& in, int64_t x, int64_t y, int64_t z)
+{
+	typedef typename PixelTypeTraits<T>::Sum Sum;
+
+	T vals[27];
+	int n = GatherNeighbourhood<T, Boundary, zRadius>(in, x, y, z, false, vals);
+	Sum running = 0;
+	for(int i = 0; i < n; i++)
+		running += vals[i];
+	return running / n;
+}
+
+template<class T, class Boundary, int zRadius> void BoxMeanSlab(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+{
+	typedef typename PixelTypeTraits<T>::Sum Sum;
+	const int count = 9 * (2 * zRadius + 1);
+
+	for(int64_t z = zBegin; z < zEnd; z++)
+	{
+		for(int64_t y = 0; y < in.height; y++)
+		{
+			T* outRow = out.Row(y, z);
+			bool interiorRow = in.width > 2 && y > 0 && y < in.height - 1 && z >= zRadius && z < in.depth - zRadius;
+
+			if(interiorRow)
+			{
+				T* rows[9];
+				int n = 0;
+				for(int64_t dz = -zRadius; dz <= zRadius; dz++)
+					for(int64_t dy = -1; dy <= 1; dy++)
+						rows[n++] = in.Row(y + dy, z + dz);
+
+				for(int64_t x = 1; x < in.width - 1; x++)
+				{
+					Sum running = 0;
+					for(int i = 0; i < n; i++)
+						running += (Sum)rows[i][x - 1] + (Sum)rows[i][x] + (Sum)rows[i][x + 1];
+					outRow[x] = running / count;
+				}
+
+				outRow[0] = BoxMeanVoxel<T, Boundary, zRadius>(in, 0, y, z);
+				outRow[in.width - 1] = BoxMeanVoxel<T, Boundary, zRadius>(in, in.width - 1, y, z);
+			}
+			else
+			{
+				for(int64_t x = 0; x < in.width; x++)
+					outRow[x] = BoxMeanVoxel<T, Boundary, zRadius>(in, x, y, z);
+			}
+		}
+	}
+}
+
+template<class T, class Boundary, int zRadius> void MedianSlab(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+{
+	T vals[27];
+
+	for(int64_t z = zBegin; z < zEnd; z++)
+	{
+		for(int64_t y = 0; y < in.height; y++)
+		{
+			T* outRow = out.Row(y, z);
+			bool interiorRow = y > 0 && y < in.height - 1 && z >= zRadius && z < in.depth - zRadius;
+
+			for(int64_t x = 0; x < in.width; x++)
+			{
+				bool interior = interiorRow && x > 0 && x < in.width - 1;
+				int n = GatherNeighbourhood<T, Boundary, zRadius>(in, x, y, z, interior, vals);
+				std::nth_element(vals, vals + n / 2, vals + n);
+				outRow[x] = vals[n / 2];
+			}
+		}
+	}
+}
+
+
+//
+//Kernel entry points, all share the Run(in, out, zBegin, zEnd) signature so they can be dispatched
+//on voxel type and boundary mode by the same code
+//
+
+
+template<class T, class Boundary> struct Smooth2DKernel
+{
+	static void Run(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+	{
+		BoxMeanSlab<T, Boundary, 0>(in, out, zBegin, zEnd);
+	}
+};
+
+template<class T, class Boundary> struct SmoothKernel
+{
+	static void Run(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+	{
+		BoxMeanSlab<T, Boundary, 1>(in, out, zBegin, zEnd);
+	}
+};
+
+template<class T, class Boundary> struct Median2DKernel
+{
+	static void Run(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+	{
+		MedianSlab<T, Boundary, 0>(in, out, zBegin, zEnd);
+	}
+};
+
+template<class T, class Boundary> struct MedianKernel
+{
+	static void Run(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int64_t zBegin, int64_t zEnd)
+	{
+		MedianSlab<T, Boundary, 1>(in, out, zBegin, zEnd);
+	}
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+#include <limits>
+
+
+//
+//Separable resampling of interleaved multi channel volumes to a new voxel count per axis. Each axis is
+//a linear (tent) filter over the input voxels, when an axis shrinks the tent widens to the output
+//voxel size so every input voxel is averaged in instead of skipped. Output voxel o sits at the centre
+//of its cell, (o + 0.5) * nIn / nOut - 0.5 in input voxels, so both grids cover the same extent. Taps
+//past the edge are clamped.
+//
+
+
+template<class T> struct ResampleTraits
+{
+	static inline T Round(float v)
+	{
+		v = std::min<float>(std::max<float>(v, std::numeric_limits<T>::lowest()), std::numeric_limits<T>::max());
+		return (T)(v >= 0 ? v + 0.5f : v - 0.5f);
+	}
+};
+
+template<> struct ResampleTraits<float>
+{
+	static inline float Round(float v) { return v; }
+};
+
+//Input indices and normalised weights along one axis, taps entries per output voxel
+struct ResampleTaps
+{
+	int taps;
+	std::vector<int64_t> index;
+	std::vector<float> weight;
+};
+
+inline void ResampleAxisTaps(int64_t nIn, int64_t nOut, ResampleTaps* axis)
+{
+	double scale = (double)nIn / nOut;
+	double radius = std::max(1.0, scale);
+	axis->taps = 2 * (int)ceil(radius) + 1;
+	axis->index.resize(nOut * axis->taps);
+	axis->weight.resize(nOut * axis->taps);
+
+	for(int64_t o = 0; o < nOut; o++)
+	{
+		double centre = (o + 0.5) * scale - 0.5;
+		int64_t first = (int64_t)floor(centre) - axis->taps / 2 + 1;
+		int64_t* index = &axis->index[o * axis->taps];
+		float* weight = &axis->weight[o * axis->taps];
+		double sum = 0;
+		for(int t = 0; t < axis->taps; t++)
+		{
+			int64_t i = first + t;
+			index[t] = std::max<int64_t>(0, std::min(i, nIn - 1));
+			weight[t] = std::max(0.0, 1.0 - fabs(i - centre) / radius);
+			sum += weight[t];
+		}
+		for(int t = 0; t < axis->taps; t++)
+			weight[t] /= sum;
+	}
+}
+
+//x pass over rows [rowBegin, rowEnd), rows of W voxels in and outW voxels out
+template<class T> void ResampleRowsX(const T* in, T* out, int64_t W, int64_t outW, int channels, const ResampleTaps& axis, int64_t rowBegin, int64_t rowEnd)
+{
+	for(int64_t r = rowBegin; r < rowEnd; r++)
+	{
+		const T* inRow = in + r * W * channels;
+		T* outRow = out + r * outW * channels;
+		for(int64_t x = 0; x < outW; x++)
+		{
+			const int64_t* index = &axis.index[x * axis.taps];
+			const float* weight = &axis.weight[x * axis.taps];
+			for(int c = 0; c < channels; c++)
+			{
+				float sum = 0;
+				for(int t = 0; t < axis.taps; t++)
+					sum += weight[t] * inRow[index[t] * channels + c];
+				outRow[x * channels + c] = ResampleTraits<T>::Round(sum);
+			}
+		}
+	}
+}
+
+//y or z pass, output lines [oBegin, oEnd) are weighted sums of whole input lines of length values,
+//rows of a slice for y and slices for z. The inner loops run over contiguous values.
+template<class T> void ResampleLines(const T* in, T* out, int64_t length, const ResampleTaps& axis, int64_t oBegin, int64_t oEnd, std::vector<float>& sum)
+{
+	sum.resize(length);
+	for(int64_t o = oBegin; o < oEnd; o++)
+	{
+		std::fill(sum.begin(), sum.end(), 0.0f);
+		for(int t = 0; t < axis.taps; t++)
+		{
+			float w = axis.weight[o * axis.taps + t];
+			if(w == 0)
+				continue;
+			const T* line = in + axis.index[o * axis.taps + t] * length;
+			for(int64_t i = 0; i < length; i++)
+				sum[i] += w * line[i];
+		}
+
+		T* outLine = out + o * length;
+		for(int64_t i = 0; i < length; i++)
+			outLine[i] = ResampleTraits<T>::Round(sum[i]);
+	}
+}
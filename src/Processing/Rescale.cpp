@@ -0,0 +1,79 @@
+#include "Rescale.hpp"
+
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+
+//Value of the low bits of a stored value, sign extended for signed data
+template<class T> static inline int32_t StoredValue(T v, int bitsStored, bool isSigned)
+{
+	int shift = 32 - bitsStored;
+	return isSigned ? ((int32_t)((uint32_t)v << shift)) >> shift : (int32_t)(((uint32_t)v << shift) >> shift);
+}
+
+//lrintf rounds like the vector conversion, to nearest even in the default mode
+static inline uint16_t RescaledValue(int32_t v, float slope, float intercept)
+{
+	long r = lrintf(v * slope + intercept);
+	return r < 0 ? 0 : (r > 65535 ? 65535 : r);
+}
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+//Four lanes at a time, packus saturates the results to 0 - 65535 so no clamp is needed
+static inline __m128i RescaleLanes(__m128i v, __m128i shift, bool isSigned, __m128 slope, __m128 intercept)
+{
+	v = _mm_sll_epi32(v, shift);
+	v = isSigned ? _mm_sra_epi32(v, shift) : _mm_srl_epi32(v, shift);
+	return _mm_cvtps_epi32(_mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(v), slope), intercept));
+}
+
+//Rescales whole blocks of 8 values, returns the first value that was not visited
+static uint64_t RescaleSIMD(const uint16_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out)
+{
+	__m128i shift = _mm_cvtsi32_si128(32 - bitsStored);
+	__m128 vSlope = _mm_set1_ps(slope);
+	__m128 vIntercept = _mm_set1_ps(intercept);
+	
+	uint64_t i = 0;
+	for(; i + 8 <= count; i += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(in + i));
+		__m128i lo = RescaleLanes(_mm_cvtepu16_epi32(v), shift, isSigned, vSlope, vIntercept);
+		__m128i hi = RescaleLanes(_mm_cvtepu16_epi32(_mm_srli_si128(v, 8)), shift, isSigned, vSlope, vIntercept);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi32(lo, hi));
+	}
+	return i;
+}
+
+#else
+
+static uint64_t RescaleSIMD(const uint16_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out)
+{
+	return 0;
+}
+
+#endif
+
+void RescaleStoredValues(const uint16_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out)
+{
+	bitsStored = std::max(1, std::min(16, bitsStored));
+	uint64_t i = RescaleSIMD(in, count, bitsStored, isSigned, slope, intercept, out);
+	for(; i < count; i++)
+		out[i] = RescaledValue(StoredValue(in[i], bitsStored, isSigned), slope, intercept);
+}
+
+void RescaleStoredValues(const uint8_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out)
+{
+	bitsStored = std::max(1, std::min(8, bitsStored));
+	for(uint64_t i = 0; i < count; i++)
+		out[i] = RescaledValue(StoredValue(in[i], bitsStored, isSigned), slope, intercept);
+}
+
+void RescaleStoredValues(const int32_t* in, uint64_t count, float slope, float intercept, uint16_t* out)
+{
+	for(uint64_t i = 0; i < count; i++)
+		out[i] = RescaledValue(in[i], slope, intercept);
+}
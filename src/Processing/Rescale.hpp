@@ -0,0 +1,12 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//out[i] = clamp(round(v * slope + intercept), 0, 65535) for count stored values, the linear map DICOM
+//calls the modality rescale. Only the low bitsStored bits of a 16 or 8 bit value are its value, signed
+//values are sign extended from bit bitsStored - 1. 32 bit values are taken whole.
+void RescaleStoredValues(const uint16_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out);
+void RescaleStoredValues(const uint8_t* in, uint64_t count, int bitsStored, bool isSigned, float slope, float intercept, uint16_t* out);
+void RescaleStoredValues(const int32_t* in, uint64_t count, float slope, float intercept, uint16_t* out);
@@ -0,0 +1,159 @@
+#pragma once
+
+
+#include "../TypedImage3D.hpp"
+
+
+//
+//Sliding window median in the style of Huang. A histogram of the (2r + 1)^3 window (or (2r + 1)^2 for
+//the 2D filter) is updated column by column as the window moves along x, so each voxel costs O(r^2)
+//histogram updates instead of sorting O(r^3) values. The histogram is split into coarse bins over the
+//upper half of the bits and fine bins over all of them. The coarse bin holding the median is tracked
+//from window to window, so finding it usually takes a step or two, and at most 2^(bits/2 - 1) fine
+//bins are scanned inside it.
+//
+
+
+template<class T> class MedianHistogram
+{
+	protected:
+		static const int bits = 8 * sizeof(T);
+		static const int coarseShift = bits / 2;
+
+		std::vector<uint16_t> coarse;
+		std::vector<uint16_t> fine;
+		size_t coarseBin;//coarse bin that held the last median
+		int coarseBelow;//window values in the coarse bins below coarseBin
+
+	public:
+		MedianHistogram()
+		{
+			coarse.assign((size_t)1 << (bits - coarseShift), 0);
+			fine.assign((size_t)1 << bits, 0);
+			coarseBin = 0;
+			coarseBelow = 0;
+		}
+
+		inline void Add(T v)
+		{
+			coarse[v >> coarseShift]++;
+			fine[v]++;
+			coarseBelow += (size_t)(v >> coarseShift) < coarseBin;
+		}
+
+		inline void Remove(T v)
+		{
+			coarse[v >> coarseShift]--;
+			fine[v]--;
+			coarseBelow -= (size_t)(v >> coarseShift) < coarseBin;
+		}
+
+		//value of the element at position rank of the sorted window. The coarse bin is tracked from the
+		//previous window, which is rarely far away, then the fine bins are scanned from whichever end of
+		//the coarse bin is closer to the rank.
+		inline T Select(int rank)
+		{
+			while(coarseBelow > rank)
+			{
+				coarseBin--;
+				coarseBelow -= coarse[coarseBin];
+			}
+			while(coarseBelow + coarse[coarseBin] <= rank)
+			{
+				coarseBelow += coarse[coarseBin];
+				coarseBin++;
+			}
+
+			int target = rank - coarseBelow;
+			if(2 * target < coarse[coarseBin])
+			{
+				size_t f = coarseBin << coarseShift;
+				int sum = 0;
+				while(sum + fine[f] <= target)
+					sum += fine[f++];
+				return f;
+			}
+			else
+			{
+				size_t f = ((coarseBin + 1) << coarseShift) - 1;
+				int sum = coarse[coarseBin] - fine[f];
+				while(sum > target)
+					sum -= fine[--f];
+				return f;
+			}
+		}
+};
+
+
+//Filters z range [zBegin, zEnd) of in into out. Window rows and columns outside the image are mapped
+//with Boundary::Index, an index of -1 reads as zero.
+template<class T, class Boundary> void SlidingMedianSlab(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int radius, bool planar, int64_t zBegin, int64_t zEnd)
+{
+	int64_t zRadius = planar ? 0 : radius;
+	int64_t side = 2 * radius + 1;
+	int rowCount = side * (2 * zRadius + 1);
+	int rank = (rowCount * side) / 2;
+
+	MedianHistogram<T> histogram;
+	std::vector<const T*> rows(rowCount);
+
+	//x index of every window column position, precomputed once for all rows
+	std::vector<int64_t> columns(in.width + side);
+	for(int64_t x = -radius - 1; x < in.width + radius; x++)
+		columns[x + radius + 1] = Boundary::Index(x, in.width);
+
+	for(int64_t z = zBegin; z < zEnd; z++)
+	{
+		for(int64_t y = 0; y < in.height; y++)
+		{
+			int n = 0;
+			for(int64_t dz = -zRadius; dz <= zRadius; dz++)
+			{
+				int64_t zi = Boundary::Index(z + dz, in.depth);
+				for(int64_t dy = -radius; dy <= radius; dy++)
+				{
+					int64_t yi = Boundary::Index(y + dy, in.height);
+					rows[n++] = zi < 0 || yi < 0 ? NULL : in.Row(yi, zi);
+				}
+			}
+
+			auto Column = [&](int64_t x, bool add)
+			{
+				int64_t xi = columns[x + radius + 1];
+				for(int i = 0; i < rowCount; i++)
+				{
+					T v = rows[i] == NULL || xi < 0 ? 0 : rows[i][xi];
+					if(add)
+						histogram.Add(v);
+					else
+						histogram.Remove(v);
+				}
+			};
+
+			for(int64_t x = -radius; x <= radius; x++)
+				Column(x, true);
+
+			T* outRow = out.Row(y, z);
+			outRow[0] = histogram.Select(rank);
+			for(int64_t x = 1; x < in.width; x++)
+			{
+				Column(x - radius - 1, false);
+				Column(x + radius, true);
+				outRow[x] = histogram.Select(rank);
+			}
+
+			//empty the histogram again by removing the last window, cheaper than clearing 2^bits bins
+			for(int64_t x = in.width - 1 - radius; x <= in.width - 1 + radius; x++)
+				Column(x, false);
+		}
+	}
+}
+
+
+template<class T, class Boundary> struct SlidingMedianKernel
+{
+	static void Run(const TypedImage3D<T>& in, const TypedImage3D<T>& out, int radius, bool planar, int64_t zBegin, int64_t zEnd)
+	{
+		SlidingMedianSlab<T, Boundary>(in, out, radius, planar, zBegin, zEnd);
+	}
+};
@@ -0,0 +1,287 @@
+#include "SobelGradient.hpp"
+
+
+#include <cmath>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
+
+//
+//The 3x3x3 Sobel operator is separable. Per z plane p of the neighbourhood three row sums are built:
+//  A = dx(y-1) + 2 dx(y) + dx(y+1)     dx = v[x-1] - v[x+1]
+//  B = sx(y-1) - sx(y+1)               sx = v[x-1] + 2 v[x] + v[x+1]
+//  C = sx(y-1) + 2 sx(y) + sx(y+1)
+//and combined across the planes to give the three 27 tap sums of the original kernel:
+//  gX = A(z-1) + 2 A(z) + A(z+1),  gY = B(z-1) + 2 B(z) + B(z+1),  gZ = C(z-1) - C(z+1)
+//Everything stays in integers, the sums are divided by 16 only when encoding.
+//
+
+
+//8 bit: ((int)(S / 16.0) + 255) / 2
+static inline unsigned char EncodeGradient8(int s)
+{
+	return (s / 16 + 255) / 2;
+}
+
+//16 bit: ((S / 16.0 + 65535) / 2) * (255 / 65535) truncated, which is exactly (S + 16 * 65535) / (32 * 257)
+static inline unsigned char EncodeGradient16(int s)
+{
+	return (uint32_t)(s + 1048560) / 8224;
+}
+
+//Octahedral encoding of the 27 tap sums. Decoded RGB8 gradients are g / (32 max) per axis, the magnitude
+//byte holds sqrt(|g| / (32 max) / (sqrt(3) / 2)) so the shaders can rebuild the same vector.
+static inline void EncodeOctahedral(int gx, int gy, int gz, double maxValue, unsigned char* out)
+{
+	double x = gx;
+	double y = gy;
+	double z = gz;
+	double l1 = std::abs(x) + std::abs(y) + std::abs(z);
+	double u = 0;
+	double v = 0;
+	if(l1 > 0)
+	{
+		u = x / l1;
+		v = y / l1;
+		//the lower hemisphere folds over the diagonals of the upper one
+		if(z < 0)
+		{
+			double fu = (1.0 - std::abs(v)) * (u >= 0 ? 1.0 : -1.0);
+			double fv = (1.0 - std::abs(u)) * (v >= 0 ? 1.0 : -1.0);
+			u = fu;
+			v = fv;
+		}
+	}
+
+	double magnitude = sqrt(x * x + y * y + z * z) / (32.0 * maxValue) / 0.8660254037844386;
+	out[0] = (unsigned char)((u * 0.5 + 0.5) * 255.0 + 0.5);
+	out[1] = (unsigned char)((v * 0.5 + 0.5) * 255.0 + 0.5);
+	out[2] = (unsigned char)(sqrt(std::min(magnitude, 1.0)) * 255.0 + 0.5);
+}
+
+static inline void EncodeGradient(int gx, int gy, int gz, GRADIENT_ENCODING encoding, uint8_t*, unsigned char* out)
+{
+	if(encoding == GRADIENT_ENCODING_OCTAHEDRAL)
+	{
+		EncodeOctahedral(gx, gy, gz, 255.0, out);
+		return;
+	}
+	out[0] = EncodeGradient8(gx);
+	out[1] = EncodeGradient8(gy);
+	out[2] = EncodeGradient8(gz);
+}
+
+static inline void EncodeGradient(int gx, int gy, int gz, GRADIENT_ENCODING encoding, uint16_t*, unsigned char* out)
+{
+	if(encoding == GRADIENT_ENCODING_OCTAHEDRAL)
+	{
+		EncodeOctahedral(gx, gy, gz, 65535.0, out);
+		return;
+	}
+	out[0] = EncodeGradient16(gx);
+	out[1] = EncodeGradient16(gy);
+	out[2] = EncodeGradient16(gz);
+}
+
+//rows[p][q] is the row at plane z-1+p and row y-1+q, already clamped to the volume
+template<class T> static inline void SobelVoxel(T* rows[3][3], uint64_t xm, uint64_t x, uint64_t xp, GRADIENT_ENCODING encoding, unsigned char* out)
+{
+	int a[3];
+	int b[3];
+	int c[3];
+	for(int p = 0; p < 3; p++)
+	{
+		int dx0 = (int)rows[p][0][xm] - (int)rows[p][0][xp];
+		int dx1 = (int)rows[p][1][xm] - (int)rows[p][1][xp];
+		int dx2 = (int)rows[p][2][xm] - (int)rows[p][2][xp];
+		int sx0 = (int)rows[p][0][xm] + 2 * (int)rows[p][0][x] + (int)rows[p][0][xp];
+		int sx1 = (int)rows[p][1][xm] + 2 * (int)rows[p][1][x] + (int)rows[p][1][xp];
+		int sx2 = (int)rows[p][2][xm] + 2 * (int)rows[p][2][x] + (int)rows[p][2][xp];
+		a[p] = dx0 + 2 * dx1 + dx2;
+		b[p] = sx0 - sx2;
+		c[p] = sx0 + 2 * sx1 + sx2;
+	}
+
+	EncodeGradient(a[0] + 2 * a[1] + a[2], b[0] + 2 * b[1] + b[2], c[0] - c[2], encoding, (T*)NULL, out);
+}
+
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+
+//
+//Lane wrappers so the SIMD row kernel is written once for AVX2 (8 lanes) and SSE4.1 (4 lanes)
+//
+
+#if defined(__AVX2__)
+
+struct SobelLanes
+{
+	typedef __m256i V;
+	static const int count = 8;
+	static inline V Load(uint8_t* p) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i*)p)); }
+	static inline V Load(uint16_t* p) { return _mm256_cvtepu16_epi32(_mm_loadu_si128((__m128i*)p)); }
+	static inline V Add(V a, V b) { return _mm256_add_epi32(a, b); }
+	static inline V Sub(V a, V b) { return _mm256_sub_epi32(a, b); }
+	static inline V Twice(V a) { return _mm256_slli_epi32(a, 1); }
+	static inline V Set(int v) { return _mm256_set1_epi32(v); }
+	static inline V Encode(V s, uint8_t*)
+	{
+		V t = _mm256_srai_epi32(_mm256_add_epi32(s, _mm256_and_si256(_mm256_srai_epi32(s, 31), Set(15))), 4);
+		return _mm256_srli_epi32(_mm256_add_epi32(t, Set(255)), 1);
+	}
+	static inline V Encode(V s, uint16_t*)
+	{
+		//(u / 32) / 257 with the division by 257 done as (x * 65281) >> 24, exact for x < 65536
+		V u = _mm256_srli_epi32(_mm256_add_epi32(s, Set(1048560)), 5);
+		return _mm256_srli_epi32(_mm256_mullo_epi32(u, Set(65281)), 24);
+	}
+	static inline void Store(int* p, V a) { _mm256_storeu_si256((V*)p, a); }
+};
+
+#else
+
+struct SobelLanes
+{
+	typedef __m128i V;
+	static const int count = 4;
+	static inline V Load(uint8_t* p) { return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(int*)p)); }
+	static inline V Load(uint16_t* p) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((__m128i*)p)); }
+	static inline V Add(V a, V b) { return _mm_add_epi32(a, b); }
+	static inline V Sub(V a, V b) { return _mm_sub_epi32(a, b); }
+	static inline V Twice(V a) { return _mm_slli_epi32(a, 1); }
+	static inline V Set(int v) { return _mm_set1_epi32(v); }
+	static inline V Encode(V s, uint8_t*)
+	{
+		V t = _mm_srai_epi32(_mm_add_epi32(s, _mm_and_si128(_mm_srai_epi32(s, 31), Set(15))), 4);
+		return _mm_srli_epi32(_mm_add_epi32(t, Set(255)), 1);
+	}
+	static inline V Encode(V s, uint16_t*)
+	{
+		V u = _mm_srli_epi32(_mm_add_epi32(s, Set(1048560)), 5);
+		return _mm_srli_epi32(_mm_mullo_epi32(u, Set(65281)), 24);
+	}
+	static inline void Store(int* p, V a) { _mm_storeu_si128((V*)p, a); }
+};
+
+#endif
+
+//Processes x in [xBegin, xEnd), all of which must have both x neighbours inside the row.
+//Returns the first x that was not processed. The octahedral encoding is scalar, only the sums are vectorised.
+template<class T> static uint64_t SobelRowSIMD(T* rows[3][3], uint64_t xBegin, uint64_t xEnd, GRADIENT_ENCODING encoding, unsigned char* out)
+{
+	typedef SobelLanes L;
+	typedef typename L::V V;
+
+	int gx[L::count];
+	int gy[L::count];
+	int gz[L::count];
+
+	uint64_t x = xBegin;
+	for(; x + L::count <= xEnd; x += L::count)
+	{
+		V a[3];
+		V b[3];
+		V c[3];
+		for(int p = 0; p < 3; p++)
+		{
+			V sx[3];
+			V dx[3];
+			for(int q = 0; q < 3; q++)
+			{
+				V vm = L::Load(rows[p][q] + x - 1);
+				V v = L::Load(rows[p][q] + x);
+				V vp = L::Load(rows[p][q] + x + 1);
+				dx[q] = L::Sub(vm, vp);
+				sx[q] = L::Add(L::Add(vm, vp), L::Twice(v));
+			}
+			a[p] = L::Add(L::Add(dx[0], dx[2]), L::Twice(dx[1]));
+			b[p] = L::Sub(sx[0], sx[2]);
+			c[p] = L::Add(L::Add(sx[0], sx[2]), L::Twice(sx[1]));
+		}
+
+		V sumX = L::Add(L::Add(a[0], a[2]), L::Twice(a[1]));
+		V sumY = L::Add(L::Add(b[0], b[2]), L::Twice(b[1]));
+		V sumZ = L::Sub(c[0], c[2]);
+		unsigned char* o = out + x * 3;
+
+		if(encoding == GRADIENT_ENCODING_OCTAHEDRAL)
+		{
+			L::Store(gx, sumX);
+			L::Store(gy, sumY);
+			L::Store(gz, sumZ);
+			for(int i = 0; i < L::count; i++)
+				EncodeGradient(gx[i], gy[i], gz[i], encoding, (T*)NULL, o + i * 3);
+			continue;
+		}
+
+		L::Store(gx, L::Encode(sumX, (T*)NULL));
+		L::Store(gy, L::Encode(sumY, (T*)NULL));
+		L::Store(gz, L::Encode(sumZ, (T*)NULL));
+		for(int i = 0; i < L::count; i++)
+		{
+			o[i * 3 + 0] = gx[i];
+			o[i * 3 + 1] = gy[i];
+			o[i * 3 + 2] = gz[i];
+		}
+	}
+
+	return x;
+}
+
+#else
+
+template<class T> static uint64_t SobelRowSIMD(T* rows[3][3], uint64_t xBegin, uint64_t xEnd, GRADIENT_ENCODING encoding, unsigned char* out)
+{
+	return xBegin;
+}
+
+#endif
+
+
+template<class T> static void SobelSlab(T* in, unsigned char* out, uint64_t width, uint64_t height, uint64_t depth, uint64_t zBegin, uint64_t zEnd, GRADIENT_ENCODING encoding)
+{
+	T* rows[3][3];
+
+	for(uint64_t z = zBegin; z < zEnd; z++)
+	{
+		uint64_t zs[3] = {z > 0 ? z - 1 : z, z, z + 1 < depth ? z + 1 : z};
+
+		for(uint64_t y = 0; y < height; y++)
+		{
+			uint64_t ys[3] = {y > 0 ? y - 1 : y, y, y + 1 < height ? y + 1 : y};
+
+			for(int p = 0; p < 3; p++)
+				for(int q = 0; q < 3; q++)
+					rows[p][q] = in + zs[p] * width * height + ys[q] * width;
+
+			unsigned char* outRow = out + (z * width * height + y * width) * 3;
+
+			//border voxels clamp their x neighbours
+			SobelVoxel(rows, 0, 0, width > 1 ? 1 : 0, encoding, outRow);
+			if(width > 1)
+				SobelVoxel(rows, width - 2, width - 1, width - 1, encoding, outRow + (width - 1) * 3);
+
+			//interior voxels, vector lanes first then the scalar tail
+			if(width > 2)
+			{
+				uint64_t x = SobelRowSIMD(rows, 1, width - 1, encoding, outRow);
+				for(; x < width - 1; x++)
+					SobelVoxel(rows, x - 1, x, x + 1, encoding, outRow + x * 3);
+			}
+		}
+	}
+}
+
+void SobelGradientSlab(void* in, int inPixelSize, unsigned char* out,
+					   uint64_t width, uint64_t height, uint64_t depth,
+					   uint64_t zBegin, uint64_t zEnd, GRADIENT_ENCODING encoding)
+{
+	if(inPixelSize == 1)//8 bit monochrome images
+		SobelSlab((uint8_t*)in, out, width, height, depth, zBegin, zEnd, encoding);
+	else if(inPixelSize == 2)//16 bit monochrome images
+		SobelSlab((uint16_t*)in, out, width, height, depth, zBegin, zEnd, encoding);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+
+#include "../Common.hpp"
+
+
+//How the three gradient bytes of a voxel are laid out. RGB8 stores each axis as (g + max) / 2, OCTAHEDRAL
+//stores the direction as an octahedral mapped unit vector in the first two bytes and the magnitude,
+//square root compressed, in the third. The octahedral layout spends all 16 bits of the first two channels
+//on the direction instead of wasting most of the cube on vectors that are not unit length, so 16 bit
+//volumes keep far finer normals for the same 3 bytes. Both decode to the same vector scale in the shaders.
+//NONE builds no gradient image at all, the shaders take central differences of the volume texture.
+enum GRADIENT_ENCODING{GRADIENT_ENCODING_RGB8, GRADIENT_ENCODING_OCTAHEDRAL, GRADIENT_ENCODING_NONE};
+
+
+//Sobel gradient of the single channel 8 (inPixelSize 1) or 16 (inPixelSize 2) bit volume in, written
+//as three bytes per voxel into out for the z range [zBegin, zEnd). With GRADIENT_ENCODING_RGB8 the channels
+//hold (g + max) / 2 scaled to 0-255 per axis, the layout the gradient Texture3D has always been built from.
+//Interior voxels take a SIMD path, only the first and last voxel of each row are clamped.
+void SobelGradientSlab(void* in, int inPixelSize, unsigned char* out,
+					   uint64_t width, uint64_t height, uint64_t depth,
+					   uint64_t zBegin, uint64_t zEnd, GRADIENT_ENCODING encoding = GRADIENT_ENCODING_RGB8);
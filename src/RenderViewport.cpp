@@ -14,6 +14,7 @@ RenderViewport::RenderViewport()
 {
 	setFocusPolicy(Qt::ClickFocus);
 	renderType = SLICE_RENDER; 
+	pyramidLevel = 0;
 }
 
 void RenderViewport::initializeGL()
@@ -146,6 +147,8 @@ void RenderViewport::paintGL()
 	glm::mat4 viewMat = cameraObject->GetViewMatrix();
 	glm::mat4 projectionMat = cameraObject->GetProjectionMatrix(windowWidth, windowHeight);
 	
+	SetPyramidLevel(volumeData->PyramidLevelForFootprint(VoxelsPerPixel(viewMat, projectionMat)));
+	
 	axisObject->Render(viewMat, projectionMat);
 	textureVolumeObject->Render(viewMat, projectionMat);
 	rayVolumeObject->Render(viewMat, projectionMat);
@@ -155,6 +158,67 @@ void RenderViewport::paintGL()
 	PrintGLErrors();
 }
 
+//Screen space footprint of a full resolution voxel at the centre of the volume. The renderers map the
+//longest physical axis onto one world unit, so along axis a that unit covers N_a * maxExtent / extent_a
+//voxels. The densest axis sets the footprint.
+double RenderViewport::VoxelsPerPixel(glm::mat4 viewMat, glm::mat4 projectionMat)
+{
+	glm::vec3 extent = volumeData->PhysicalExtent();
+	if(textureVolume->Width() == 0 || windowHeight <= 0 || extent.x <= 0 || extent.y <= 0 || extent.z <= 0)
+		return 1.0;
+
+	double maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+	double voxelsPerUnit = std::max(textureVolume->Width() / extent.x, std::max(textureVolume->Height() / extent.y, textureVolume->Depth() / extent.z)) * maxExtent;
+	
+	//the 2D camera zooms by scaling, so measure a world unit in view space first
+	double viewScale = glm::length(glm::vec3(viewMat * glm::vec4(1, 0, 0, 0)));
+	double pixelsPerUnit = 0.5 * windowHeight * projectionMat[1][1] * viewScale;
+	if(!cameraObject->GetOrtho())
+	{
+		glm::vec4 centre = viewMat * glm::vec4(0, 0, 0, 1);
+		pixelsPerUnit /= std::max(std::abs(centre.z), 0.1f);
+	}
+	
+	return voxelsPerUnit / std::max(pixelsPerUnit, 1e-6);
+}
+
+//textures are set on every frame, a rebuilt pyramid has new level textures even at the same level
+void RenderViewport::SetPyramidLevel(int level)
+{
+	Texture3D* volume = volumeData->VolumeTexture(level);
+	Texture3D* gradient = volumeData->GradientTexture(level);
+	textureSliceObject->SetVolumeTexture(volume); 
+	textureSliceObject->SetGradientTexture(gradient); 
+	textureVolumeObject->SetVolumeTexture(volume); 
+	textureVolumeObject->SetGradientTexture(gradient); 
+	rayVolumeObject->SetVolumeTexture(volume); 
+	rayVolumeObject->SetGradientTexture(gradient); 
+	photonVolumeObject->SetVolumeTexture(volume); 
+	photonVolumeObject->SetGradientTexture(gradient); 
+	
+	//proportions come from the voxel spacing of level 0, the rounded up level sizes drift from them
+	glm::vec3 extent = volumeData->PhysicalExtent();
+	textureSliceObject->SetVolumeExtent(extent); 
+	textureVolumeObject->SetVolumeExtent(extent); 
+	rayVolumeObject->SetVolumeExtent(extent); 
+	photonVolumeObject->SetVolumeExtent(extent); 
+	
+	//shader gradients are measured per texel of whichever level is bound
+	float voxelScale = volume->Width() > 0 ? (float)textureVolume->Width() / volume->Width() : 1.0f;
+	rayVolumeObject->SetVoxelScale(voxelScale);
+	photonVolumeObject->SetVoxelScale(voxelScale);
+	
+	MacrocellGrid* macrocells = volumeData->Macrocells(level);
+	Texture3D* occupancy = macrocells->CellCount() > 0 ? volumeData->OccupancyTexture(level) : NULL;
+	rayVolumeObject->SetOccupancyTexture(occupancy, macrocells->CellSize());
+	photonVolumeObject->SetOccupancyTexture(occupancy, macrocells->CellSize());
+	
+	//accumulated photon frames came from the other level
+	if(level != pyramidLevel)
+		photonVolumeObject->ClearPhotonRender(windowWidth, windowHeight);
+	pyramidLevel = level;
+}
+
 void RenderViewport::mousePressEvent(QMouseEvent *event)
 {
 	cameraControl3D->mousePressEvent(event);
@@ -202,6 +266,11 @@ void RenderViewport::LoadLUT(float* buffer, int sizeLUT)
 		textureLUT->Allocate(sizeLUT);
 	textureLUT->LoadData(buffer);
 	
+	std::vector<float> opacity(sizeLUT);
+	for(int i = 0; i < sizeLUT; i++)
+		opacity[i] = buffer[i * 4 + 3];
+	volumeData->SetLUTOpacity(opacity);
+	
 	Refresh();
 }
 
@@ -350,6 +419,7 @@ void RenderViewport::SetGradientThreshold(float threshold)
 {
 	rayVolumeObject->SetGradientThreshold(threshold);
 	photonVolumeObject->SetGradientThreshold(threshold);
+	volumeData->SetGradientThreshold(threshold);
 	
 	Refresh();
 }
@@ -362,6 +432,15 @@ void RenderViewport::SetBackFaceCulling(bool cull)
 	Refresh();
 }
 
+void RenderViewport::SetGradientEncoding(GRADIENT_ENCODING encoding)
+{
+	volumeData->SetGradientEncoding(encoding);
+	rayVolumeObject->SetGradientEncoding(encoding);
+	photonVolumeObject->SetGradientEncoding(encoding);
+	
+	Refresh();
+}
+
 void RenderViewport::SetBrightness(double b)
 {
 	textureSliceObject->SetBrightness(b);
@@ -25,7 +25,10 @@ class RenderViewport: public QOpenGLWidget
 	protected:
 		int windowWidth;
 		int windowHeight; 
+		int pyramidLevel;
 	
+		double VoxelsPerPixel(glm::mat4 viewMat, glm::mat4 projectionMat);
+		void SetPyramidLevel(int level);
 		void initializeGL();
 		void paintGL();
 		void resizeGL(int w, int h);
@@ -64,6 +67,7 @@ class RenderViewport: public QOpenGLWidget
 		void ChooseRenderer(RENDER_TYPE rt);
 		void SetGradientThreshold(float threshold);
 		void SetBackFaceCulling(bool cull); 
+		void SetGradientEncoding(GRADIENT_ENCODING encoding); 
 		void SetBrightness(double b); 
 		void SetContrast(double c); 
 		void SetThreshold(double t); 
@@ -81,11 +81,17 @@ uniform sampler3D volumeTexture;
 uniform sampler3D gradientTexture;
 uniform samplerCube envMapTexture;
 uniform vec3 texDim;
+uniform vec3 volumeExtent;//physical size of the volume, only its proportions matter
 uniform float brightness;
 uniform float contrast;
 uniform float gradientThreshold;
 uniform int backFaceCulling; 
+uniform int gradientEncoding;
+uniform float voxelScale;
 uniform sampler1D lutTexture;
+uniform sampler3D occupancyTexture;
+uniform int occupancyEnabled;
+uniform float occupancyCellSize;
 
 //output
 layout(location = 0) out vec4 outputColor; 
@@ -160,19 +166,81 @@ vec3 RandomUnitHemi(vec2 randomVal, vec3 norm)
 	return rh * sign(dot(rh, norm));
 }
 
+//world to texture coordinates, the longest axis of the volume spans the unit cube around the origin
+vec3 TextureScale()
+{
+	return max(volumeExtent.x, max(volumeExtent.y, volumeExtent.z)) / volumeExtent;
+}
+
 //3d Volume Fetch
 vec4 Fetch3DVolume(vec3 position)
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
-	return texture(volumeTexture, (position.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f)));
+	vec3 texScale = TextureScale();
+	return texture(volumeTexture, (position.xyz * texScale + vec3(0.5f, 0.5f, 0.5f)));
+}
+
+//octahedral unit vector from the first two gradient channels, the inverse of EncodeOctahedral
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec2 p = e * 2.0f - vec2(1.0f, 1.0f);
+	vec3 n = vec3(p.x, p.y, 1.0f - abs(p.x) - abs(p.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
 }
 
 vec3 FetchGradient(vec3 position)
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
-	return texture(gradientTexture, (position.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f))).xyz - vec3(0.5f, 0.5f, 0.5f);
+	vec3 texScale = TextureScale();
+	vec3 texCoord = position.xyz * texScale + vec3(0.5f, 0.5f, 0.5f);
+	
+	//no gradient texture, central differences of the volume clamped to the edge texels like the CPU
+	//Sobel and scaled to one full resolution voxel, (v[x-1] - v[x+1]) / 2 matches the RGB8 scale
+	if(gradientEncoding == 2)
+	{
+		vec3 h = vec3(1, 1, 1) / texDim;
+		vec3 lo = 0.5f * h;
+		vec3 hi = vec3(1, 1, 1) - 0.5f * h;
+		float gx = texture(volumeTexture, clamp(texCoord - vec3(h.x, 0, 0), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(h.x, 0, 0), lo, hi)).r;
+		float gy = texture(volumeTexture, clamp(texCoord - vec3(0, h.y, 0), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(0, h.y, 0), lo, hi)).r;
+		float gz = texture(volumeTexture, clamp(texCoord - vec3(0, 0, h.z), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(0, 0, h.z), lo, hi)).r;
+		return vec3(gx, gy, gz) * (0.5f / voxelScale);
+	}
+	
+	vec3 encoded = texture(gradientTexture, texCoord).xyz;
+	
+	//octahedral: direction in xy, square root of the magnitude over its maximum sqrt(3) / 2 in z
+	if(gradientEncoding == 1)
+		return DecodeOctahedral(encoded.xy) * (encoded.z * encoded.z * 0.8660254f);
+	return encoded - vec3(0.5f, 0.5f, 0.5f);
+}
+
+//Number of steps along dir that stay in empty macrocells, 0 when the cell at position may hold a surface.
+//A cell at distance d from the nearest such cell is the centre of an empty box 2d - 1 cells wide, the
+//count runs to the first step past that box so samples stay on the same grid as plain marching.
+int EmptySpaceSteps(vec3 position, vec3 dir, float stepSize)
+{
+	if(!bool(occupancyEnabled))
+		return 0;
+	
+	vec3 texScale = TextureScale();
+	vec3 texCoord = position * texScale + vec3(0.5f, 0.5f, 0.5f);
+	if(any(lessThan(texCoord, vec3(0, 0, 0))) || any(greaterThanEqual(texCoord, vec3(1, 1, 1))))
+		return 0;
+	
+	vec3 cellTexSize = occupancyCellSize / texDim;
+	ivec3 cell = ivec3(texCoord / cellTexSize);
+	float distance = floor(texelFetch(occupancyTexture, cell, 0).r * 255.0f + 0.5f);
+	if(distance == 0)
+		return 0;
+	
+	vec3 boxMin = (vec3(cell) - (distance - 1)) * cellTexSize;
+	vec3 boxMax = (vec3(cell) + distance) * cellTexSize;
+	vec3 texDir = dir * texScale;
+	vec3 toExit = mix(texCoord - boxMin, boxMax - texCoord, step(0, texDir));
+	vec3 exitDist = toExit / max(abs(texDir), vec3(1e-6f, 1e-6f, 1e-6f));
+	return max(1, int(ceil(min(exitDist.x, min(exitDist.y, exitDist.z)) / stepSize)));
 }
 
 vec4 FetchEnvMap(vec3 dir)
@@ -263,7 +331,8 @@ void main()
 	vec3 rayDirNorm = normalize(rayDir); 
 	vec3 rayDirInv = vec3(1, 1, 1) / rayDirNorm; 
 
-	HitInfo hit = RayAABBIntersect(rayOrig, rayDirInv, vec3(-0.5, -0.5, -0.5), vec3(0.5, 0.5, 0.5), BIGNUM);
+	vec3 volumeHalf = 0.5f / TextureScale();
+	HitInfo hit = RayAABBIntersect(rayOrig, rayDirInv, -volumeHalf, volumeHalf, BIGNUM);
 	
 
 	float stepSize = 0.002f;
@@ -289,34 +358,43 @@ void main()
 		for(int i = 0; i < photonMarchCount; i++)
 		{
 			
-			vec3 gradient = FetchGradient(photonPos);
-			float gradientLen = length(gradient);
-					
-			if(gradientLen > gradientThreshold)
+			//empty space, leap over it and go straight to the exit test
+			int leap = EmptySpaceSteps(photonPos, photonDir, stepSize);
+			if(leap == 0)
 			{
-				vec3 gradientNorm = normalize(gradient);
-				if(dot(-photonDir, gradientNorm) > 0 || !bool(backFaceCulling))
-				{
-					vec4 col = Fetch3DVolume(photonPos + -gradientNorm * stepSize * 3);
-					vec4 surface = texture(lutTexture, col.r);
-					vec3 surfacecol = surface.xyz; 
-					float surfaceopacity = surface.w;
+				vec3 gradient = FetchGradient(photonPos);
+				float gradientLen = length(gradient);
 					
+				if(gradientLen > gradientThreshold)
+				{
+					vec3 gradientNorm = normalize(gradient);
+					if(dot(-photonDir, gradientNorm) > 0 || !bool(backFaceCulling))
+					{
+						vec4 col = Fetch3DVolume(photonPos + -gradientNorm * stepSize * 3);
+						vec4 surface = texture(lutTexture, col.r);
+						vec3 surfacecol = surface.xyz; 
+						float surfaceopacity = surface.w;
 					
-					vec2 randomSeedVec2 = vec2(randomFloat0 * float(i * sampleNumber + s) / float(sampleNumber * photonMarchCount),
-											   randomFloat1 * float(s * photonMarchCount + i) / float(sampleNumber * photonMarchCount));
-					vec3 newRayD = RandomUnitHemi(Random(gl_FragCoord.xy, randomSeedVec2) * 2.0f - vec2(1.0f, 1.0f), gradientNorm);
-					vec3 reflectanceFactor = max(0.0f, dot(newRayD, gradientNorm)) * surface.xyz;
-					runningReflectanceFactor *= reflectanceFactor;
+						//transparent entries are no surface, empty space skipping relies on that
+						if(surfaceopacity > 0)
+						{
+							vec2 randomSeedVec2 = vec2(randomFloat0 * float(i * sampleNumber + s) / float(sampleNumber * photonMarchCount),
+													   randomFloat1 * float(s * photonMarchCount + i) / float(sampleNumber * photonMarchCount));
+							vec3 newRayD = RandomUnitHemi(Random(gl_FragCoord.xy, randomSeedVec2) * 2.0f - vec2(1.0f, 1.0f), gradientNorm);
+							vec3 reflectanceFactor = max(0.0f, dot(newRayD, gradientNorm)) * surface.xyz;
+							runningReflectanceFactor *= reflectanceFactor;
 					
-					photonDir = newRayD;
+							photonDir = newRayD;
+						}
+					}
 				}
+				leap = 1;
 			}
-					
-			photonPos += photonDir * stepSize;
 			
-			if(photonPos.x > 0.5f || photonPos.y > 0.5f || photonPos.z > 0.5f || 
-			   photonPos.x < -0.5f || photonPos.y < -0.5f || photonPos.z < -0.5f)
+			photonPos += photonDir * (stepSize * leap);
+			i += leap - 1;
+			
+			if(any(greaterThan(abs(photonPos), volumeHalf)))
 			{
 				vec4 backgroundTex = FetchEnvMap(photonDir);
 				vec3 materialEmittance = backgroundTex.xyz;
@@ -446,6 +524,10 @@ PhotonVolumeObject::PhotonVolumeObject()
 	contrast = 1;
 	gradientThreshold = 0.06;
 	backFaceCulling = true; 
+	gradientEncoding = GRADIENT_ENCODING_RGB8;
+	voxelScale = 1;
+	occupancyTexture = NULL;
+	occupancyCellSize = 8;
 }
 
 
@@ -513,6 +595,7 @@ void PhotonVolumeObject::Init()
 	ogl->glBindBuffer(GL_ARRAY_BUFFER, 0);
 	
 	volumeTexture = NULL; 
+	volumeExtent = glm::vec3(0, 0, 0);
 	
 	lutTexture = NULL; 
 	
@@ -615,6 +698,9 @@ void PhotonVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix
 	//update 3d texture volume
 	int texDimLocation = ogl->glGetUniformLocation(programShaderObject, "texDim"); 
 	ogl->glUniform3f(texDimLocation, (float)volumeTexture->Width(), (float)volumeTexture->Height(), (float)volumeTexture->Depth());
+	glm::vec3 extent = volumeExtent.x > 0 ? volumeExtent : glm::vec3(volumeTexture->Width(), volumeTexture->Height(), volumeTexture->Depth());
+	int volumeExtentLocation = ogl->glGetUniformLocation(programShaderObject, "volumeExtent"); 
+	ogl->glUniform3f(volumeExtentLocation, extent.x, extent.y, extent.z);
 	int volumeTextureLocation = ogl->glGetUniformLocation(programShaderObject, "volumeTexture"); 
 	ogl->glUniform1i(volumeTextureLocation, 0);
 	ogl->glActiveTexture(GL_TEXTURE0 + 0);
@@ -648,7 +734,8 @@ void PhotonVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-		float bcolor[] = { 0.5f, 0.5f, 0.5f, 0.0f };
+		//zero gradient outside the volume, the octahedral magnitude lives in the third channel
+		float bcolor[] = { 0.5f, 0.5f, gradientEncoding == GRADIENT_ENCODING_OCTAHEDRAL ? 0.0f : 0.5f, 0.0f };
 		ogl->glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, bcolor);
 	}
 	else
@@ -695,6 +782,30 @@ void PhotonVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix
 		ogl->glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 	}
 	
+	//update macrocell distances, whole cells are looked up so there is no filtering
+	int occupancyTextureLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyTexture"); 
+	ogl->glUniform1i(occupancyTextureLocation, 4);
+	ogl->glActiveTexture(GL_TEXTURE0 + 4);
+	bool occupancyEnabled = occupancyTexture != NULL && occupancyTexture->Width() > 0;
+	if(occupancyEnabled)
+	{
+		ogl->glBindTexture(GL_TEXTURE_3D, occupancyTexture->GetTextureId());
+		
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else
+	{
+		ogl->glBindTexture(GL_TEXTURE_3D, 0);
+	}
+	int occupancyEnabledLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyEnabled"); 
+	ogl->glUniform1i(occupancyEnabledLocation, (int)occupancyEnabled);
+	int occupancyCellSizeLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyCellSize"); 
+	ogl->glUniform1f(occupancyCellSizeLocation, occupancyCellSize);
+	
 	//update material uniforms
 	int randomFloat0Location = ogl->glGetUniformLocation(programShaderObject, "randomFloat0"); 
 	ogl->glUniform1f(randomFloat0Location, randDist(randGenerator));
@@ -708,6 +819,10 @@ void PhotonVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix
 	ogl->glUniform1f(materialGradientThresholdLocation, gradientThreshold);
 	int materialBackFaceCullingLocation = ogl->glGetUniformLocation(programShaderObject, "backFaceCulling"); 
 	ogl->glUniform1i(materialBackFaceCullingLocation, (int)backFaceCulling);
+	int gradientEncodingLocation = ogl->glGetUniformLocation(programShaderObject, "gradientEncoding"); 
+	ogl->glUniform1i(gradientEncodingLocation, (int)gradientEncoding);
+	int voxelScaleLocation = ogl->glGetUniformLocation(programShaderObject, "voxelScale"); 
+	ogl->glUniform1f(voxelScaleLocation, voxelScale);
 	
 	
 	//check if the frame buffer is complete
@@ -834,6 +949,11 @@ void PhotonVolumeObject::SetVolumeTexture(Texture3D* vt)
 	volumeTexture = vt; 
 }
 
+void PhotonVolumeObject::SetVolumeExtent(glm::vec3 extent)
+{
+	volumeExtent = extent;
+}
+
 
 void PhotonVolumeObject::SetGradientTexture(Texture3D* gt)
 {
@@ -860,3 +980,19 @@ void PhotonVolumeObject::SetBackFaceCulling(bool cull)
 {
 	backFaceCulling = cull;
 }
+
+void PhotonVolumeObject::SetGradientEncoding(GRADIENT_ENCODING encoding)
+{
+	gradientEncoding = encoding;
+}
+
+void PhotonVolumeObject::SetVoxelScale(float scale)
+{
+	voxelScale = scale;
+}
+
+void PhotonVolumeObject::SetOccupancyTexture(Texture3D* ot, float cellSize)
+{
+	occupancyTexture = ot;
+	occupancyCellSize = cellSize;
+}
@@ -5,6 +5,7 @@
 #include "Texture3D.hpp"
 #include "TextureCube.hpp"
 #include "Texture1D.hpp"
+#include "../Processing/SobelGradient.hpp"
 
 
 class PhotonVolumeObject: public Object3D
@@ -40,7 +41,10 @@ class PhotonVolumeObject: public Object3D
 		Texture1D* lutTexture; 
 		
 		Texture3D* volumeTexture; 
+		glm::vec3 volumeExtent;
 		Texture3D* gradientTexture; 
+		Texture3D* occupancyTexture; 
+		float occupancyCellSize;
 		TextureCube* envMapTexture;
 		
 		unsigned int volumeSlices;
@@ -67,6 +71,8 @@ class PhotonVolumeObject: public Object3D
 		float contrast;
 		float gradientThreshold;
 		bool backFaceCulling; 
+		GRADIENT_ENCODING gradientEncoding;
+		float voxelScale;
 		
 	
 	public:
@@ -80,9 +86,13 @@ class PhotonVolumeObject: public Object3D
 		void ClearPhotonRender(int W, int H);
 		
 		void SetVolumeTexture(Texture3D* vt);
+		void SetVolumeExtent(glm::vec3 extent);//spacing times voxel count of the volume, zero uses the texture size
 		void SetGradientTexture(Texture3D* gt);
 		void SetLUTTexture(Texture1D* lt);
 		void SetEnvMap(TextureCube* env);
 		void SetGradientThreshold(float gt);
 		void SetBackFaceCulling(bool cull);
+		void SetGradientEncoding(GRADIENT_ENCODING encoding);
+		void SetVoxelScale(float scale);//full resolution voxels per texel of the volume texture
+		void SetOccupancyTexture(Texture3D* ot, float cellSize);//macrocell distances, NULL disables skipping
 };
\ No newline at end of file
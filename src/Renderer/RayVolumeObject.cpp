@@ -47,11 +47,17 @@ uniform mat4 viewMatrix;
 uniform sampler3D volumeTexture;
 uniform sampler3D gradientTexture;
 uniform vec3 texDim;
+uniform vec3 volumeExtent;//physical size of the volume, only its proportions matter
 uniform float brightness;
 uniform float contrast;
 uniform float gradientThreshold;
 uniform int backFaceCulling; 
+uniform int gradientEncoding;
+uniform float voxelScale;
 uniform sampler1D lutTexture;
+uniform sampler3D occupancyTexture;
+uniform int occupancyEnabled;
+uniform float occupancyCellSize;
 
 //output
 layout(location = 0) out vec4 outputColor; 
@@ -104,19 +110,81 @@ float Random(vec2 f, float seed)
 }
 
 
+//world to texture coordinates, the longest axis of the volume spans the unit cube around the origin
+vec3 TextureScale()
+{
+	return max(volumeExtent.x, max(volumeExtent.y, volumeExtent.z)) / volumeExtent;
+}
+
 //3d Volume Fetch
 vec4 Fetch3DVolume(vec3 position)
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
-	return texture(volumeTexture, (position.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f)));
+	vec3 texScale = TextureScale();
+	return texture(volumeTexture, (position.xyz * texScale + vec3(0.5f, 0.5f, 0.5f)));
+}
+
+//octahedral unit vector from the first two gradient channels, the inverse of EncodeOctahedral
+vec3 DecodeOctahedral(vec2 e)
+{
+	vec2 p = e * 2.0f - vec2(1.0f, 1.0f);
+	vec3 n = vec3(p.x, p.y, 1.0f - abs(p.x) - abs(p.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
 }
 
 vec3 FetchGradient(vec3 position)
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
-	return texture(gradientTexture, (position.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f))).xyz - vec3(0.5f, 0.5f, 0.5f);
+	vec3 texScale = TextureScale();
+	vec3 texCoord = position.xyz * texScale + vec3(0.5f, 0.5f, 0.5f);
+	
+	//no gradient texture, central differences of the volume clamped to the edge texels like the CPU
+	//Sobel and scaled to one full resolution voxel, (v[x-1] - v[x+1]) / 2 matches the RGB8 scale
+	if(gradientEncoding == 2)
+	{
+		vec3 h = vec3(1, 1, 1) / texDim;
+		vec3 lo = 0.5f * h;
+		vec3 hi = vec3(1, 1, 1) - 0.5f * h;
+		float gx = texture(volumeTexture, clamp(texCoord - vec3(h.x, 0, 0), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(h.x, 0, 0), lo, hi)).r;
+		float gy = texture(volumeTexture, clamp(texCoord - vec3(0, h.y, 0), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(0, h.y, 0), lo, hi)).r;
+		float gz = texture(volumeTexture, clamp(texCoord - vec3(0, 0, h.z), lo, hi)).r - texture(volumeTexture, clamp(texCoord + vec3(0, 0, h.z), lo, hi)).r;
+		return vec3(gx, gy, gz) * (0.5f / voxelScale);
+	}
+	
+	vec3 encoded = texture(gradientTexture, texCoord).xyz;
+	
+	//octahedral: direction in xy, square root of the magnitude over its maximum sqrt(3) / 2 in z
+	if(gradientEncoding == 1)
+		return DecodeOctahedral(encoded.xy) * (encoded.z * encoded.z * 0.8660254f);
+	return encoded - vec3(0.5f, 0.5f, 0.5f);
+}
+
+//Number of steps along dir that stay in empty macrocells, 0 when the cell at position may hold a surface.
+//A cell at distance d from the nearest such cell is the centre of an empty box 2d - 1 cells wide, the
+//count runs to the first step past that box so samples stay on the same grid as plain marching.
+int EmptySpaceSteps(vec3 position, vec3 dir, float stepSize)
+{
+	if(!bool(occupancyEnabled))
+		return 0;
+	
+	vec3 texScale = TextureScale();
+	vec3 texCoord = position * texScale + vec3(0.5f, 0.5f, 0.5f);
+	if(any(lessThan(texCoord, vec3(0, 0, 0))) || any(greaterThanEqual(texCoord, vec3(1, 1, 1))))
+		return 0;
+	
+	vec3 cellTexSize = occupancyCellSize / texDim;
+	ivec3 cell = ivec3(texCoord / cellTexSize);
+	float distance = floor(texelFetch(occupancyTexture, cell, 0).r * 255.0f + 0.5f);
+	if(distance == 0)
+		return 0;
+	
+	vec3 boxMin = (vec3(cell) - (distance - 1)) * cellTexSize;
+	vec3 boxMax = (vec3(cell) + distance) * cellTexSize;
+	vec3 texDir = dir * texScale;
+	vec3 toExit = mix(texCoord - boxMin, boxMax - texCoord, step(0, texDir));
+	vec3 exitDist = toExit / max(abs(texDir), vec3(1e-6f, 1e-6f, 1e-6f));
+	return max(1, int(ceil(min(exitDist.x, min(exitDist.y, exitDist.z)) / stepSize)));
 }
 
 //main
@@ -128,7 +196,8 @@ void main()
 	vec3 lightDir1 = vec3(-0.707f, 0, 0.707f);
 	vec3 lightDir2 = vec3(0, 0.707f, -0.707f);
 	
-	HitInfo hi = RayAABBIntersect(rayOrig, rayDirInv, vec3(-0.5, -0.5, -0.5), vec3(0.5, 0.5, 0.5), BIGNUM);
+	vec3 volumeHalf = 0.5f / TextureScale();
+	HitInfo hi = RayAABBIntersect(rayOrig, rayDirInv, -volumeHalf, volumeHalf, BIGNUM);
 	
 	if(!hi.hit)
 		discard;
@@ -138,10 +207,17 @@ void main()
 	
 	vec4 finalColor = vec4(0, 0, 0, 0);
 	
-	
-	
 	for(int i = 0; i < 500; i++)
 	{
+		//empty space, leap over it
+		int leap = EmptySpaceSteps(rayStart, rayDirNorm, stepSize);
+		if(leap > 0)
+		{
+			rayStart += rayDirNorm * (stepSize * leap);
+			i += leap - 1;
+			continue;
+		}
+		
 		vec3 gradient = FetchGradient(rayStart);
 		float gradientLen = length(gradient);
 		 		
@@ -155,6 +231,12 @@ void main()
 				vec3 surfacecol = surface.xyz; 
 				float surfaceopacity = surface.w;
 				
+				//transparent entries are no surface, empty space skipping relies on that
+				if(surfaceopacity <= 0)
+				{
+					rayStart += rayDirNorm * stepSize;
+					continue;
+				}
 				
 				
 				float diffuse = 0.5 * max(0, dot(gradientNorm, lightDir0)) + 
@@ -244,6 +326,10 @@ RayVolumeObject::RayVolumeObject()
 	contrast = 1;
 	gradientThreshold = 0.06;
 	backFaceCulling = true; 
+	gradientEncoding = GRADIENT_ENCODING_RGB8;
+	voxelScale = 1;
+	occupancyTexture = NULL;
+	occupancyCellSize = 8;
 }
 
 
@@ -303,6 +389,7 @@ void RayVolumeObject::Init()
 	ogl->glBindBuffer(GL_ARRAY_BUFFER, 0);
 	
 	volumeTexture = NULL; 
+	volumeExtent = glm::vec3(0, 0, 0);
 	
 	lutTexture = NULL; 
 }
@@ -336,6 +423,9 @@ void RayVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	//update 3d texture volume
 	int texDimLocation = ogl->glGetUniformLocation(programShaderObject, "texDim"); 
 	ogl->glUniform3f(texDimLocation, (float)volumeTexture->Width(), (float)volumeTexture->Height(), (float)volumeTexture->Depth());
+	glm::vec3 extent = volumeExtent.x > 0 ? volumeExtent : glm::vec3(volumeTexture->Width(), volumeTexture->Height(), volumeTexture->Depth());
+	int volumeExtentLocation = ogl->glGetUniformLocation(programShaderObject, "volumeExtent"); 
+	ogl->glUniform3f(volumeExtentLocation, extent.x, extent.y, extent.z);
 	int volumeTextureLocation = ogl->glGetUniformLocation(programShaderObject, "volumeTexture"); 
 	ogl->glUniform1i(volumeTextureLocation, 0);
 	ogl->glActiveTexture(GL_TEXTURE0 + 0);
@@ -369,7 +459,8 @@ void RayVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
 		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_BORDER);
-		float bcolor[] = { 0.5f, 0.5f, 0.5f, 0.0f };
+		//zero gradient outside the volume, the octahedral magnitude lives in the third channel
+		float bcolor[] = { 0.5f, 0.5f, gradientEncoding == GRADIENT_ENCODING_OCTAHEDRAL ? 0.0f : 0.5f, 0.0f };
 		ogl->glTexParameterfv(GL_TEXTURE_3D, GL_TEXTURE_BORDER_COLOR, bcolor);
 	}
 	else
@@ -399,6 +490,30 @@ void RayVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	
 	
 	
+	//update macrocell distances, whole cells are looked up so there is no filtering
+	int occupancyTextureLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyTexture"); 
+	ogl->glUniform1i(occupancyTextureLocation, 3);
+	ogl->glActiveTexture(GL_TEXTURE0 + 3);
+	bool occupancyEnabled = occupancyTexture != NULL && occupancyTexture->Width() > 0;
+	if(occupancyEnabled)
+	{
+		ogl->glBindTexture(GL_TEXTURE_3D, occupancyTexture->GetTextureId());
+		
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		ogl->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	}
+	else
+	{
+		ogl->glBindTexture(GL_TEXTURE_3D, 0);
+	}
+	int occupancyEnabledLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyEnabled"); 
+	ogl->glUniform1i(occupancyEnabledLocation, (int)occupancyEnabled);
+	int occupancyCellSizeLocation = ogl->glGetUniformLocation(programShaderObject, "occupancyCellSize"); 
+	ogl->glUniform1f(occupancyCellSizeLocation, occupancyCellSize);
+	
 	//update material uniforms
 	int materialAlphaLocation = ogl->glGetUniformLocation(programShaderObject, "brightness"); 
 	ogl->glUniform1f(materialAlphaLocation, brightness);
@@ -408,6 +523,10 @@ void RayVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
 	ogl->glUniform1f(materialGradientThresholdLocation, gradientThreshold);
 	int materialBackFaceCullingLocation = ogl->glGetUniformLocation(programShaderObject, "backFaceCulling"); 
 	ogl->glUniform1i(materialBackFaceCullingLocation, (int)backFaceCulling);
+	int gradientEncodingLocation = ogl->glGetUniformLocation(programShaderObject, "gradientEncoding"); 
+	ogl->glUniform1i(gradientEncodingLocation, (int)gradientEncoding);
+	int voxelScaleLocation = ogl->glGetUniformLocation(programShaderObject, "voxelScale"); 
+	ogl->glUniform1f(voxelScaleLocation, voxelScale);
 	
 	//bind VAO
 	ogl->glBindVertexArray(vertexArrayObject);
@@ -439,6 +558,11 @@ void RayVolumeObject::SetVolumeTexture(Texture3D* vt)
 	volumeTexture = vt; 
 }
 
+void RayVolumeObject::SetVolumeExtent(glm::vec3 extent)
+{
+	volumeExtent = extent;
+}
+
 
 void RayVolumeObject::SetGradientTexture(Texture3D* gt)
 {
@@ -460,3 +584,19 @@ void RayVolumeObject::SetBackFaceCulling(bool cull)
 {
 	backFaceCulling = cull;
 }
+
+void RayVolumeObject::SetGradientEncoding(GRADIENT_ENCODING encoding)
+{
+	gradientEncoding = encoding;
+}
+
+void RayVolumeObject::SetVoxelScale(float scale)
+{
+	voxelScale = scale;
+}
+
+void RayVolumeObject::SetOccupancyTexture(Texture3D* ot, float cellSize)
+{
+	occupancyTexture = ot;
+	occupancyCellSize = cellSize;
+}
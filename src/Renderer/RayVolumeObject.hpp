@@ -4,6 +4,7 @@
 #include "Object3D.hpp"
 #include "Texture3D.hpp"
 #include "Texture1D.hpp"
+#include "../Processing/SobelGradient.hpp"
 
 
 class RayVolumeObject: public Object3D
@@ -34,7 +35,10 @@ class RayVolumeObject: public Object3D
 		Texture1D* lutTexture; 
 		
 		Texture3D* volumeTexture; 
+		glm::vec3 volumeExtent;
 		Texture3D* gradientTexture; 
+		Texture3D* occupancyTexture; 
+		float occupancyCellSize;
 		
 		unsigned int volumeSlices;
 		
@@ -45,6 +49,8 @@ class RayVolumeObject: public Object3D
 		float contrast;
 		float gradientThreshold;
 		bool backFaceCulling; 
+		GRADIENT_ENCODING gradientEncoding;
+		float voxelScale;
 		
 	
 	public:
@@ -56,8 +62,12 @@ class RayVolumeObject: public Object3D
 		virtual void Destroy();
 		
 		void SetVolumeTexture(Texture3D* vt);
+		void SetVolumeExtent(glm::vec3 extent);//spacing times voxel count of the volume, zero uses the texture size
 		void SetGradientTexture(Texture3D* gt);
 		void SetLUTTexture(Texture1D* lt);
 		void SetGradientThreshold(float gt);
 		void SetBackFaceCulling(bool cull);
+		void SetGradientEncoding(GRADIENT_ENCODING encoding);
+		void SetVoxelScale(float scale);//full resolution voxels per texel of the volume texture
+		void SetOccupancyTexture(Texture3D* ot, float cellSize);//macrocell distances, NULL disables skipping
 };
\ No newline at end of file
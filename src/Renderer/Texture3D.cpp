@@ -73,7 +73,9 @@ void Texture3D::LoadData(void* buffer)
 	int dataType = dataTypes[bytesPerSample-1];
 	
 	ogl->glBindTexture(GL_TEXTURE_3D, textureId);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	ogl->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, width, height, depth, dataFormat, dataType, buffer);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 	ogl->glBindTexture(GL_TEXTURE_3D, 0);
 }
 
@@ -88,7 +90,58 @@ void Texture3D::LoadDataSlice(void* buffer, uint64_t Z)
 	int dataType = dataTypes[bytesPerSample-1];
 	
 	ogl->glBindTexture(GL_TEXTURE_3D, textureId);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	ogl->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, Z, width, height, 1, dataFormat, dataType, buffer);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	ogl->glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void Texture3D::LoadDataSlab(void* buffer, uint64_t zBegin, uint64_t zCount)
+{
+	OPENGL_FUNC_MACRO
+
+	int dataFormats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+	int dataFormat = dataFormats[channels-1];
+	
+	int dataTypes[] = {GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT}; 
+	int dataType = dataTypes[bytesPerSample-1];
+	
+	ogl->glBindTexture(GL_TEXTURE_3D, textureId);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	ogl->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, zBegin, width, height, zCount, dataFormat, dataType, buffer);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	ogl->glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+void Texture3D::LoadDataRegion(Image3DView view, uint64_t x, uint64_t y, uint64_t z)
+{
+	if(view.VoxelCount() == 0)
+		return;
+	if(view.PixelSize() != (uint64_t)(channels * bytesPerSample))
+	{
+		std::cout << "Texture3D: view voxels do not match the texture format" << std::endl;
+		return;
+	}
+	
+	OPENGL_FUNC_MACRO
+
+	int dataFormats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+	int dataFormat = dataFormats[channels-1];
+	
+	int dataTypes[] = {GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT}; 
+	int dataType = dataTypes[bytesPerSample-1];
+	
+	//rows and slices of the view lie rowStride and sliceStride voxels apart in its image
+	ogl->glBindTexture(GL_TEXTURE_3D, textureId);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	ogl->glPixelStorei(GL_UNPACK_ROW_LENGTH, view.RowStride());
+	ogl->glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, view.Depth() > 1 ? view.SliceStride() / view.RowStride() : 0);
+	ogl->glTexSubImage3D(GL_TEXTURE_3D, 0, x, y, z, view.Width(), view.Height(), view.Depth(), dataFormat, dataType, view.Data());
+	ogl->glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	ogl->glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+	ogl->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
 	ogl->glBindTexture(GL_TEXTURE_3D, 0);
 }
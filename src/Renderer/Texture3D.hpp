@@ -2,6 +2,7 @@
 
 
 #include "../Common.hpp"
+#include "../Image3DView.hpp"
 
 
 class Texture3D
@@ -20,6 +21,8 @@ class Texture3D
 		void Destroy();
 		void LoadData(void* buffer);
 		void LoadDataSlice(void* buffer, uint64_t Z);
+		void LoadDataSlab(void* buffer, uint64_t zBegin, uint64_t zCount);//buffer holds slices zBegin to zBegin + zCount - 1
+		void LoadDataRegion(Image3DView view, uint64_t x, uint64_t y, uint64_t z);//view goes to the texels from x, y, z on, strides are passed to GL so it is not copied
 		unsigned int GetTextureId();
 		uint64_t Width();
 		uint64_t Height();
@@ -32,6 +32,7 @@ in vec4 fragmentPosition;
 
 uniform sampler3D volumeTexture;
 uniform vec3 texDim;
+uniform vec3 volumeExtent;//physical size of the volume, only its proportions matter
 uniform float brightness;
 uniform float contrast;
 uniform float threshold; 
@@ -43,10 +44,10 @@ layout(location = 0) out vec4 outputColor;
 //main
 void main()
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
+	//the longest axis of the volume spans the unit cube around the origin
+	vec3 texScale = max(volumeExtent.x, max(volumeExtent.y, volumeExtent.z)) / volumeExtent;
 	
-	vec4 col = texture(volumeTexture, (fragmentPosition.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f)));
+	vec4 col = texture(volumeTexture, (fragmentPosition.xyz * texScale + vec3(0.5f, 0.5f, 0.5f)));
 	
 	if(col.w <= 0.0001f)
 		discard; 
@@ -182,6 +183,7 @@ void TextureSliceObject::Init()
 	ogl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	
 	volumeTexture = NULL; 
+	volumeExtent = glm::vec3(0, 0, 0);
 	
 	lutTexture = NULL; 
 }
@@ -235,6 +237,9 @@ void TextureSliceObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatrix
 	//update 3d texture
 	int texDimLocation = ogl->glGetUniformLocation(programShaderObject, "texDim"); 
 	ogl->glUniform3f(texDimLocation, (float)volumeTexture->Width(), (float)volumeTexture->Height(), (float)volumeTexture->Depth());
+	glm::vec3 extent = volumeExtent.x > 0 ? volumeExtent : glm::vec3(volumeTexture->Width(), volumeTexture->Height(), volumeTexture->Depth());
+	int volumeExtentLocation = ogl->glGetUniformLocation(programShaderObject, "volumeExtent"); 
+	ogl->glUniform3f(volumeExtentLocation, extent.x, extent.y, extent.z);
 	int volumeTextureLocation = ogl->glGetUniformLocation(programShaderObject, "volumeTexture"); 
 	ogl->glUniform1i(volumeTextureLocation, 0);
 	ogl->glActiveTexture(GL_TEXTURE0 + 0);
@@ -316,6 +321,12 @@ void TextureSliceObject::SetVolumeTexture(Texture3D* vt)
 }
 
 
+void TextureSliceObject::SetVolumeExtent(glm::vec3 extent)
+{
+	volumeExtent = extent;
+}
+
+
 void TextureSliceObject::SetGradientTexture(Texture3D* gt)
 {
 	gradientTexture = gt; 
@@ -40,6 +40,7 @@ uniform mat4 invMVMatrix;
 uniform mat4 projectionMatrix;
 uniform sampler3D volumeTexture;
 uniform vec3 texDim;
+uniform vec3 volumeExtent;//physical size of the volume, only its proportions matter
 uniform float brightness;
 uniform float contrast;
 uniform sampler1D lutTexture;
@@ -50,13 +51,13 @@ layout(location = 0) out vec4 outputColor;
 //main
 void main()
 {
-	float hasp = texDim.x / texDim.y;
-	float dasp = texDim.z / texDim.y;
+	//the longest axis of the volume spans the unit cube around the origin
+	vec3 texScale = max(volumeExtent.x, max(volumeExtent.y, volumeExtent.z)) / volumeExtent;
 	
 	vec3 fp = fragmentPosition.xyz;
 	
 	vec4 fragPos = invMVMatrix * vec4(fp, 0.0f);
-	vec4 col = texture(volumeTexture, (fragPos.xyz * vec3(1, 1, 1/dasp) + vec3(0.5f, 0.5f, 0.5f)));
+	vec4 col = texture(volumeTexture, (fragPos.xyz * texScale + vec3(0.5f, 0.5f, 0.5f)));
 	if(col.w <= 0.0001f)
 		discard; 
 	
@@ -192,6 +193,7 @@ void TextureVolumeObject::Init()
 	ogl->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	
 	volumeTexture = NULL; 
+	volumeExtent = glm::vec3(0, 0, 0);
 	
 	lutTexture = NULL; 
 }
@@ -245,6 +247,9 @@ void TextureVolumeObject::Render(glm::mat4 viewMatrix, glm::mat4 projectionMatri
 	//update 3d texture
 	int texDimLocation = ogl->glGetUniformLocation(programShaderObject, "texDim"); 
 	ogl->glUniform3f(texDimLocation, (float)volumeTexture->Width(), (float)volumeTexture->Height(), (float)volumeTexture->Depth());
+	glm::vec3 extent = volumeExtent.x > 0 ? volumeExtent : glm::vec3(volumeTexture->Width(), volumeTexture->Height(), volumeTexture->Depth());
+	int volumeExtentLocation = ogl->glGetUniformLocation(programShaderObject, "volumeExtent"); 
+	ogl->glUniform3f(volumeExtentLocation, extent.x, extent.y, extent.z);
 	int volumeTextureLocation = ogl->glGetUniformLocation(programShaderObject, "volumeTexture"); 
 	ogl->glUniform1i(volumeTextureLocation, 0);
 	ogl->glActiveTexture(GL_TEXTURE0 + 0);
@@ -325,6 +330,12 @@ void TextureVolumeObject::SetVolumeTexture(Texture3D* vt)
 }
 
 
+void TextureVolumeObject::SetVolumeExtent(glm::vec3 extent)
+{
+	volumeExtent = extent;
+}
+
+
 void TextureVolumeObject::SetGradientTexture(Texture3D* gt)
 {
 	gradientTexture = gt; 
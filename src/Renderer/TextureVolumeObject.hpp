@@ -34,6 +34,7 @@ class TextureVolumeObject: public Object3D
 		Texture1D* lutTexture; 
 		
 		Texture3D* volumeTexture; 
+		glm::vec3 volumeExtent;
 		Texture3D* gradientTexture; 
 		
 		unsigned int volumeSlices;
@@ -54,6 +55,7 @@ class TextureVolumeObject: public Object3D
 		virtual void Destroy();
 		
 		void SetVolumeTexture(Texture3D* vt);
+		void SetVolumeExtent(glm::vec3 extent);//spacing times voxel count of the volume, zero uses the texture size
 		void SetGradientTexture(Texture3D* gt);
 		void SetLUTTexture(Texture1D* lt);
 };
\ No newline at end of file
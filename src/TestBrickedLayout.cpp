@@ -0,0 +1,80 @@
+#include "TestBrickedLayout.hpp"
+
+
+#include "Image3D.hpp"
+#include "BrickedImage3D.hpp"
+
+#include <cstring>
+
+
+static double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+//smooth blobs plus noise so the median has something to sort
+static void FillTestVolume(Image3D& img)
+{
+	std::mt19937 rng(1234);
+	uint16_t* data = (uint16_t*)img.Data();
+	for(uint64_t z = 0; z < img.Depth(); z++)
+	{
+		for(uint64_t y = 0; y < img.Height(); y++)
+		{
+			for(uint64_t x = 0; x < img.Width(); x++)
+			{
+				double v = 0.5 + 0.25 * sin(x * 0.05) * cos(y * 0.07) + 0.2 * sin(z * 0.11);
+				data[(z * img.Height() + y) * img.Width() + x] = v * 60000 + rng() % 4096;
+			}
+		}
+	}
+}
+
+void TestBrickedLayout(uint64_t W, uint64_t H, uint64_t D)
+{
+	std::cout << "TestBrickedLayout: " << W << "x" << H << "x" << D << " 16 bit" << std::endl;
+
+	Image3D source(W, H, D, PIXEL_TYPE_UINT16);
+	FillTestVolume(source);
+
+	Image3D linear(W, H, D, PIXEL_TYPE_UINT16);
+	memcpy(linear.Data(), source.Data(), source.ByteSize());
+
+	auto start = std::chrono::high_resolution_clock::now();
+	linear.Smooth();
+	double linearSmooth = SecondsSince(start);
+
+	start = std::chrono::high_resolution_clock::now();
+	linear.Median();
+	double linearMedian = SecondsSince(start);
+
+	std::cout << "TestBrickedLayout: linear     smooth " << linearSmooth << "s median " << linearMedian << "s" << std::endl;
+
+	uint64_t brickSizes[2] = {8, 16};
+	for(int i = 0; i < 2; i++)
+	{
+		BrickedImage3D bricked;
+		Image3D result;
+
+		start = std::chrono::high_resolution_clock::now();
+		bricked.FromImage3D(source, brickSizes[i], BRICK_ORDER_MORTON);
+		double toBricks = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		bricked.Smooth();
+		double brickedSmooth = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		bricked.Median();
+		double brickedMedian = SecondsSince(start);
+
+		start = std::chrono::high_resolution_clock::now();
+		bricked.ToImage3D(result);
+		double fromBricks = SecondsSince(start);
+
+		bool same = memcmp(result.Data(), linear.Data(), linear.ByteSize()) == 0;
+
+		std::cout << "TestBrickedLayout: bricks " << brickSizes[i] << "^3 smooth " << brickedSmooth << "s median " << brickedMedian << "s"
+				  << " (to bricks " << toBricks << "s, back " << fromBricks << "s) " << (same ? "identical" : "MISMATCH") << std::endl;
+	}
+}
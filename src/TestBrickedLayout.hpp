@@ -0,0 +1,10 @@
+#pragma once
+
+
+#include "Common.hpp"
+
+
+//Times Smooth and Median on a synthetic 16 bit W x H x D volume in the linear layout and bricked in
+//8^3 and 16^3 bricks (including the conversions), checks both layouts give the same voxels and prints
+//the results. Run with --benchmark-bricked [W H D], the default is 1024 x 1024 x 64.
+void TestBrickedLayout(uint64_t W, uint64_t H, uint64_t D);
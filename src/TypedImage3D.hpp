@@ -0,0 +1,176 @@
+#pragma once
+
+
+#include "Common.hpp"
+
+
+//Voxel types an Image3D can hold. Everything but PIXEL_TYPE_RAW is single channel, RAW images
+//(rgb gradients, rgba env maps, ...) are only described by their pixel size.
+enum PIXEL_TYPE{PIXEL_TYPE_RAW, PIXEL_TYPE_UINT8, PIXEL_TYPE_UINT16, PIXEL_TYPE_INT16, PIXEL_TYPE_FLOAT};
+
+//Bytes per voxel of the single channel types, 0 for RAW
+inline uint64_t PixelTypeSize(PIXEL_TYPE type)
+{
+	switch(type)
+	{
+		case PIXEL_TYPE_UINT8: return 1;
+		case PIXEL_TYPE_UINT16: return 2;
+		case PIXEL_TYPE_INT16: return 2;
+		case PIXEL_TYPE_FLOAT: return 4;
+		default: return 0;
+	}
+}
+
+//How filters treat neighbours that fall outside the volume
+enum BOUNDARY_MODE{BOUNDARY_CLAMP, BOUNDARY_MIRROR, BOUNDARY_ZERO};
+
+
+//
+//PixelTypeTraits
+//
+
+
+template<class T> struct PixelTypeTraits;
+
+template<> struct PixelTypeTraits<uint8_t>
+{
+	static const PIXEL_TYPE type = PIXEL_TYPE_UINT8;
+	typedef int Sum;
+};
+
+template<> struct PixelTypeTraits<uint16_t>
+{
+	static const PIXEL_TYPE type = PIXEL_TYPE_UINT16;
+	typedef int Sum;
+};
+
+template<> struct PixelTypeTraits<int16_t>
+{
+	static const PIXEL_TYPE type = PIXEL_TYPE_INT16;
+	typedef int Sum;
+};
+
+template<> struct PixelTypeTraits<float>
+{
+	static const PIXEL_TYPE type = PIXEL_TYPE_FLOAT;
+	typedef double Sum;
+};
+
+
+//
+//TypedImage3D
+//
+
+
+//Non owning, typed access to a z-y-x voxel buffer. Rows are rowStride and slices sliceStride voxels
+//apart, for a linear buffer these are width and width * height.
+template<class T> class TypedImage3D
+{
+	public:
+		typedef T Voxel;
+		
+		T* data;
+		int64_t width;
+		int64_t height;
+		int64_t depth;
+		int64_t rowStride;
+		int64_t sliceStride;
+
+		TypedImage3D()
+		{
+			data = NULL;
+			width = 0;
+			height = 0;
+			depth = 0;
+			rowStride = 0;
+			sliceStride = 0;
+		}
+
+		TypedImage3D(T* d, int64_t W, int64_t H, int64_t D)
+		{
+			data = d;
+			width = W;
+			height = H;
+			depth = D;
+			rowStride = W;
+			sliceStride = W * H;
+		}
+
+		TypedImage3D(T* d, int64_t W, int64_t H, int64_t D, int64_t rowStep, int64_t sliceStep)
+		{
+			data = d;
+			width = W;
+			height = H;
+			depth = D;
+			rowStride = rowStep;
+			sliceStride = sliceStep;
+		}
+
+		inline T* Row(int64_t y, int64_t z) const
+		{
+			return data + z * sliceStride + y * rowStride;
+		}
+
+		inline T& At(int64_t x, int64_t y, int64_t z) const
+		{
+			return data[z * sliceStride + y * rowStride + x];
+		}
+};
+
+
+//
+//Boundary policies, Fetch reads a voxel that may lie outside the image. Any image type with width,
+//height, depth, a Voxel typedef and At(x, y, z) can be fetched from.
+//
+
+
+struct BoundaryClamp
+{
+	static const BOUNDARY_MODE mode = BOUNDARY_CLAMP;
+
+	static inline int64_t Index(int64_t i, int64_t n)
+	{
+		return i < 0 ? 0 : (i >= n ? n - 1 : i);
+	}
+
+	template<class Image> static inline typename Image::Voxel Fetch(const Image& img, int64_t x, int64_t y, int64_t z)
+	{
+		return img.At(Index(x, img.width), Index(y, img.height), Index(z, img.depth));
+	}
+};
+
+struct BoundaryMirror
+{
+	static const BOUNDARY_MODE mode = BOUNDARY_MIRROR;
+
+	//reflect about the edge voxel without repeating it, -1 -> 1 and n -> n-2
+	static inline int64_t Index(int64_t i, int64_t n)
+	{
+		if(i < 0) i = -i;
+		if(i >= n) i = 2 * n - 2 - i;
+		return BoundaryClamp::Index(i, n);
+	}
+
+	template<class Image> static inline typename Image::Voxel Fetch(const Image& img, int64_t x, int64_t y, int64_t z)
+	{
+		return img.At(Index(x, img.width), Index(y, img.height), Index(z, img.depth));
+	}
+};
+
+struct BoundaryZero
+{
+	static const BOUNDARY_MODE mode = BOUNDARY_ZERO;
+
+	//-1 marks an index outside the image, the voxel reads as zero
+	static inline int64_t Index(int64_t i, int64_t n)
+	{
+		return i < 0 || i >= n ? -1 : i;
+	}
+
+	template<class Image> static inline typename Image::Voxel Fetch(const Image& img, int64_t x, int64_t y, int64_t z)
+	{
+		if(x < 0 || x >= img.width || y < 0 || y >= img.height || z < 0 || z >= img.depth)
+			return 0;
+		return img.At(x, y, z);
+	}
+};
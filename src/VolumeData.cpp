@@ -2,6 +2,11 @@
 
 
 #include "Util.hpp"
+#include "Parallel.hpp"
+
+#include <atomic>
+#include <cstring>
+#include <stdlib.h>
 
 #include "IO/Image3DFromDicomFile.hpp"
 #include "IO/Image3DFromDevilFile.hpp"
@@ -10,7 +15,31 @@
 
 VolumeData::VolumeData()
 {
+	gradientEncoding = GRADIENT_ENCODING_RGB8;
+	gradientThreshold = 0.06;
+	
+	const char* spacing = getenv("VOLUMETRIC_RENDERER_IMPORT_SPACING");
+	importSpacing = spacing != NULL ? atof(spacing) : 0;
+}
+
+void VolumeData::SetImportSpacing(double spacing)
+{
+	importSpacing = spacing;
+}
+
+void VolumeData::ResampleForImport()
+{
+	if(importSpacing <= 0)
+		return;
 	
+	auto start = std::chrono::high_resolution_clock::now();
+	intensityImage.ResampleIsotropic(importSpacing);
+	std::cout << "VolumeData: Resampled to " << intensityImage.Width() << " x " << intensityImage.Height() << " x " << intensityImage.Depth() << " in " << std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count() << "s" << std::endl; 
+}
+
+glm::vec3 VolumeData::PhysicalExtent()
+{
+	return glm::vec3(intensityImage.Width() * intensityImage.SpacingX(), intensityImage.Height() * intensityImage.SpacingY(), intensityImage.Depth() * intensityImage.SpacingZ());
 }
 
 void VolumeData::ImportDicomFileSequence(QStringList fileNames)
@@ -21,8 +50,11 @@ void VolumeData::ImportDicomFileSequence(QStringList fileNames)
 	bool loadGood = Image3DFromDicomFileSequence(&intensityImage, files);
 	if(!loadGood)
 		return; 
-	textureVolume.Allocate(intensityImage.Width(), intensityImage.Height(), intensityImage.Depth());
-	textureVolume.LoadData(intensityImage.Data());
+	
+	loadGood = BuildFromImage3D();
+	
+	if(!loadGood)
+		return;
 }
 
 void VolumeData::ImportImageFile(QString fileName)
@@ -81,50 +113,418 @@ bool VolumeData::BuildFromImage3D()
 		return false;
 	}
 	
+	if(intensityImage.Type() != PIXEL_TYPE_UINT8 && intensityImage.Type() != PIXEL_TYPE_UINT16)
+	{
+		std::cout << "VolumeData: Only 8 and 16 bit intensity images are supported" << std::endl; 
+		return false;
+	}
+	
 	std::cout << "VolumeData: Pre Processing intensity image" << std::endl; 
+	ResampleForImport();
 
 	//intensityImage.Normalize();
 	//intensityImage.Median2D();
 	
-	std::cout << "VolumeData: Building intensity texture" << std::endl; 
-	textureVolume.Allocate(intensityImage.Width(), intensityImage.Height(), intensityImage.Depth(), false, 1, 2);
-	textureVolume.LoadData(intensityImage.Data());
+	//BCT is always applied to an untouched copy of the image so it can be undone and never compounds
+	//rounding, the pipeline fills it in alongside the other stages
+	std::cout << "VolumeData: Building textures, histogram and gradient image" << std::endl; 
+	BuildPipelined(true, true);
+	bctSteps.clear();
 	
-	std::cout << "VolumeData: Building histogram" << std::endl; 
-	intensityImage.Histogram(&textureVolumeHistogram); 
+	intensityImage.HistogramCounts(&intensityHistogram); 
+	sourceHistogram = intensityHistogram;
+	Image3D::NormalizeHistogram(intensityHistogram, &textureVolumeHistogram); 
 	
-	std::cout << "VolumeData: Building gradient image" << std::endl; 
-	gradientImage.Allocate(intensityImage.Width(), intensityImage.Height(), intensityImage.Depth(), 3);
 	
-	gradientImage.Sobel(intensityImage);
+	return true; 
+}
+
+void VolumeData::ApplyBCTSettings(double b, double c, double t)
+{
+	BrightnessContrastThresholdSettings step;
+	step.brightness = b;
+	step.contrast = c;
+	step.threshold = t;
+	bctSteps.push_back(step);
 	
-	std::cout << "VolumeData: Building gradient texture" << std::endl; 
-	textureGradient.Allocate(gradientImage.Width(), gradientImage.Height(), gradientImage.Depth(), false, 3);
-	textureGradient.LoadData(gradientImage.Data());
+	RebuildFromBCTSettings();
+}
+
+void VolumeData::UndoBCTSettings()
+{
+	if(bctSteps.empty())
+		return;
 	
+	bctSteps.pop_back();
+	RebuildFromBCTSettings();
+}
+
+void VolumeData::ResetBCTSettings()
+{
+	if(bctSteps.empty())
+		return;
 	
-	return true; 
+	bctSteps.clear();
+	RebuildFromBCTSettings();
 }
 
-void VolumeData::ApplyBCTSettings(double b, double c, double t)
+void VolumeData::RebuildFromBCTSettings()
+{
+	if(intensityImage.Type() != PIXEL_TYPE_UINT8 && intensityImage.Type() != PIXEL_TYPE_UINT16)
+	{
+		std::cout << "VolumeData: BCT needs an 8 or 16 bit intensity image" << std::endl; 
+		return;
+	}
+	
+	//every import keeps its source in BuildFromImage3D, without one nothing is loaded yet
+	if(sourceImage.ByteSize() == 0)
+		return;
+	
+	//all steps fold into a single table, one streaming pass from the source gives the result
+	std::cout << "VolumeData: Applying BCT lookup table" << std::endl; 
+	std::vector<uint16_t> lut;
+	Image3D::BrightnessContrastThresholdLUT(bctSteps, sourceHistogram.size(), &lut);
+	intensityImage.ApplyLookupTable(sourceImage, lut);
+	
+	//the histogram goes through the same table, no voxel has to be counted again
+	Image3D::LookupTableHistogram(sourceHistogram, lut, &intensityHistogram); 
+	Image3D::NormalizeHistogram(intensityHistogram, &textureVolumeHistogram); 
+	
+	std::cout << "VolumeData: Building textures and gradient image" << std::endl; 
+	BuildPipelined(false, false);
+}
+
+void VolumeData::SetGradientEncoding(GRADIENT_ENCODING encoding)
+{
+	if(encoding == gradientEncoding)
+		return;
+	gradientEncoding = encoding;
+	
+	//nothing to rebuild before a volume is loaded
+	if(textureVolume.Width() == 0 || sourceImage.ByteSize() == 0)
+		return;
+	
+	std::cout << "VolumeData: Rebuilding gradient image" << std::endl; 
+	BuildPipelined(false, false);
+}
+
+static double SecondsSince(std::chrono::high_resolution_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VolumeData::BuildPipelined(bool buildHistogram, bool copySource)
+{
+	uint64_t width = intensityImage.Width();
+	uint64_t height = intensityImage.Height();
+	uint64_t depth = intensityImage.Depth();
+	uint64_t sliceBytes = width * height * intensityImage.PixelSize();
+	
+	auto wallStart = std::chrono::high_resolution_clock::now();
+	
+	//without a gradient image the renderers still bind a gradient texture, a single voxel one will do
+	bool buildGradient = gradientEncoding != GRADIENT_ENCODING_NONE;
+	textureVolume.Allocate(width, height, depth, false, 1, intensityImage.PixelSize());
+	gradientImage.Deallocate();
+	if(buildGradient)
+	{
+		gradientImage.Allocate(width, height, depth, 3);
+		textureGradient.Allocate(width, height, depth, false, 3);
+	}
+	else
+		textureGradient.Allocate(1, 1, 1, false, 3);
+	if(copySource)
+	{
+		sourceImage.Deallocate();
+		sourceImage.Allocate(width, height, depth, intensityImage.Type());
+		sourceImage.SetSpacing(intensityImage.SpacingX(), intensityImage.SpacingY(), intensityImage.SpacingZ());
+	}
+	
+	//a few slabs per worker keeps every stage busy without making the uploads too small
+	WorkerPool pool;
+	uint64_t slabDepth = std::max<uint64_t>(1, depth / (4 * pool.ThreadCount()));
+	uint64_t slabCount = (depth + slabDepth - 1) / slabDepth;
+	
+	std::vector<uint64_t> counts;
+	std::mutex countsMutex;
+	std::vector<bool> slabReady(slabCount, false);
+	std::mutex readyMutex;
+	std::condition_variable readyChanged;
+	std::atomic<uint64_t> histogramTime(0);
+	std::atomic<uint64_t> gradientTime(0);
+	std::atomic<uint64_t> copyTime(0);
+	
+	for(uint64_t slab = 0; slab < slabCount; slab++)
+	{
+		pool.Submit([&, slab]()
+		{
+			uint64_t zBegin = slab * slabDepth;
+			uint64_t zEnd = std::min(depth, zBegin + slabDepth);
+			
+			//out of core images, ask for the slab and its z neighbours before the kernels fault them in
+			intensityImage.Advise(MAPPED_ADVICE_WILLNEED, zBegin > 0 ? zBegin - 1 : 0, std::min(depth, zEnd + 1));
+			
+			auto start = std::chrono::high_resolution_clock::now();
+			if(buildHistogram)
+				intensityImage.HistogramCountsSlab(zBegin, zEnd, &counts, &countsMutex);
+			histogramTime += SecondsSince(start) * 1e9;
+			
+			start = std::chrono::high_resolution_clock::now();
+			if(buildGradient)
+				gradientImage.Sobel(intensityImage, zBegin, zEnd, gradientEncoding);
+			gradientTime += SecondsSince(start) * 1e9;
+			
+			start = std::chrono::high_resolution_clock::now();
+			if(copySource)
+				memcpy((unsigned char*)sourceImage.Data() + zBegin * sliceBytes, (unsigned char*)intensityImage.Data() + zBegin * sliceBytes, (zEnd - zBegin) * sliceBytes);
+			copyTime += SecondsSince(start) * 1e9;
+			
+			//the source is only read again when BCT changes, let it go back to the file
+			if(copySource)
+				sourceImage.Advise(MAPPED_ADVICE_DONTNEED, zBegin, zEnd);
+			
+			std::lock_guard<std::mutex> lock(readyMutex);
+			slabReady[slab] = true;
+			readyChanged.notify_all();
+		});
+	}
+	
+	//GL calls stay on this thread. The intensity slabs are ready from the start and fill the time until
+	//the first gradient slab is done, gradient slabs go up in order as soon as they are finished.
+	double intensityUploadTime = 0;
+	double gradientUploadTime = 0;
+	double waitTime = 0;
+	uint64_t nextGradient = 0;
+	
+	auto UploadGradient = [&](uint64_t slab)
+	{
+		if(!buildGradient)
+			return;
+		uint64_t zBegin = slab * slabDepth;
+		uint64_t zEnd = std::min(depth, zBegin + slabDepth);
+		auto start = std::chrono::high_resolution_clock::now();
+		textureGradient.LoadDataRegion(gradientImage.View().Slab(zBegin, zEnd), 0, 0, zBegin);
+		gradientUploadTime += SecondsSince(start);
+		gradientImage.Advise(MAPPED_ADVICE_DONTNEED, zBegin, zEnd);
+	};
+	
+	auto IsReady = [&](uint64_t slab)
+	{
+		std::lock_guard<std::mutex> lock(readyMutex);
+		return (bool)slabReady[slab];
+	};
+	
+	for(uint64_t slab = 0; slab < slabCount; slab++)
+	{
+		uint64_t zBegin = slab * slabDepth;
+		uint64_t zEnd = std::min(depth, zBegin + slabDepth);
+		auto start = std::chrono::high_resolution_clock::now();
+		textureVolume.LoadDataRegion(intensityImage.View().Slab(zBegin, zEnd), 0, 0, zBegin);
+		intensityUploadTime += SecondsSince(start);
+		
+		while(nextGradient < slabCount && IsReady(nextGradient))
+			UploadGradient(nextGradient++);
+	}
+	
+	while(nextGradient < slabCount)
+	{
+		auto start = std::chrono::high_resolution_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(readyMutex);
+			readyChanged.wait(lock, [&]{ return (bool)slabReady[nextGradient]; });
+		}
+		waitTime += SecondsSince(start);
+		UploadGradient(nextGradient++);
+	}
+	
+	pool.Wait();
+	
+	if(buildHistogram)
+	{
+		intensityImage.SetHistogramCounts(counts);
+		if(copySource)
+			sourceImage.SetHistogramCounts(counts);
+	}
+	
+	//worker stage times are summed over all workers
+	std::cout << "VolumeData: Pipeline " << SecondsSince(wallStart) << "s for " << slabCount << " slabs on " << pool.ThreadCount() << " workers" << std::endl; 
+	std::cout << "VolumeData:   histogram " << histogramTime * 1e-9 << "s, gradient " << gradientTime * 1e-9 << "s, source copy " << copyTime * 1e-9 << "s (worker time)" << std::endl; 
+	std::cout << "VolumeData:   intensity upload " << intensityUploadTime << "s, gradient upload " << gradientUploadTime << "s, waiting for gradients " << waitTime << "s" << std::endl; 
+	
+	BuildPyramid();
+	BuildMacrocells();
+}
+
+void VolumeData::BuildPyramid(DOWNSAMPLE_FILTER filter, uint64_t minSize)
 {
-	intensityImage.BrightnessContrastThreshold(b, c, t);
+	auto start = std::chrono::high_resolution_clock::now();
 	
+	ClearPyramid();
 	
+	Image3D* intensity = &intensityImage;
+	Image3D* gradient = &gradientImage;
+	while(std::max(intensity->Width(), std::max(intensity->Height(), intensity->Depth())) >= 2 * minSize)
+	{
+		std::unique_ptr<VolumeLevel> level(new VolumeLevel);
+		Image3D& li = level->intensityImage;
+		li.Downsample(*intensity, filter);
+		level->textureVolume.Allocate(li.Width(), li.Height(), li.Depth(), false, 1, li.PixelSize());
+		level->textureVolume.LoadDataSlab(li.Data(), 0, li.Depth());
+		
+		//averaging octahedral coordinates is wrong across the folds, those levels get their own Sobel pass.
+		//A level n voxel spans 2^n full resolution ones so its differences come out 2^n times larger,
+		//scale the square root compressed magnitude back so the gradient threshold means the same.
+		if(gradientEncoding == GRADIENT_ENCODING_OCTAHEDRAL)
+		{
+			level->gradientImage.Allocate(li.Width(), li.Height(), li.Depth(), 3);
+			level->gradientImage.Sobel(li, gradientEncoding);
+			
+			double scale = pow(0.5, 0.5 * (pyramidLevels.size() + 1));
+			unsigned char* g = (unsigned char*)level->gradientImage.Data();
+			ParallelFor(0, li.Width() * li.Height() * li.Depth(), [&](uint64_t begin, uint64_t end)
+			{
+				for(uint64_t i = begin; i < end; i++)
+					g[i * 3 + 2] = g[i * 3 + 2] * scale + 0.5;
+			});
+		}
+		else if(gradientEncoding == GRADIENT_ENCODING_RGB8)
+			level->gradientImage.Downsample(*gradient, filter);
+		
+		if(gradientEncoding == GRADIENT_ENCODING_NONE)
+			level->textureGradient.Allocate(1, 1, 1, false, 3);
+		else
+		{
+			level->textureGradient.Allocate(li.Width(), li.Height(), li.Depth(), false, 3);
+			level->textureGradient.LoadDataSlab(level->gradientImage.Data(), 0, li.Depth());
+		}
+		
+		intensity = &level->intensityImage;
+		gradient = &level->gradientImage;
+		pyramidLevels.push_back(std::move(level));
+	}
 	
-	std::cout << "VolumeData: Building intensity texture" << std::endl; 
-	textureVolume.Allocate(intensityImage.Width(), intensityImage.Height(), intensityImage.Depth(), false, 1, 2);
-	textureVolume.LoadData(intensityImage.Data());
+	std::cout << "VolumeData: Pyramid of " << PyramidLevels() << " levels built in " << SecondsSince(start) << "s" << std::endl; 
+}
+
+void VolumeData::ClearPyramid()
+{
+	for(size_t i = 0; i < pyramidLevels.size(); i++)
+	{
+		pyramidLevels[i]->textureVolume.Destroy();
+		pyramidLevels[i]->textureGradient.Destroy();
+		pyramidLevels[i]->textureOccupancy.Destroy();
+	}
+	pyramidLevels.clear();
+}
+
+int VolumeData::PyramidLevels()
+{
+	return pyramidLevels.size() + 1;
+}
+
+int VolumeData::PyramidLevelForFootprint(double voxelsPerPixel)
+{
+	//the finest level that still puts no more than about one voxel behind each pixel
+	int level = 0;
+	while(level + 1 < PyramidLevels() && voxelsPerPixel >= 2.0)
+	{
+		voxelsPerPixel *= 0.5;
+		level++;
+	}
+	return level;
+}
+
+Texture3D* VolumeData::VolumeTexture(int level)
+{
+	if(level <= 0 || level >= PyramidLevels())
+		return &textureVolume;
+	return &pyramidLevels[level - 1]->textureVolume;
+}
+
+Texture3D* VolumeData::GradientTexture(int level)
+{
+	if(level <= 0 || level >= PyramidLevels())
+		return &textureGradient;
+	return &pyramidLevels[level - 1]->textureGradient;
+}
+
+void VolumeData::BuildMacrocells(uint64_t cellSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
 	
-	std::cout << "VolumeData: Building histogram" << std::endl; 
-	intensityImage.Histogram(&textureVolumeHistogram); 
+	for(int level = 0; level < PyramidLevels(); level++)
+	{
+		Image3D& image = level == 0 ? intensityImage : pyramidLevels[level - 1]->intensityImage;
+		
+		//the LUT is read 5 ray steps (0.01 world units) inside the surface. The longest physical axis spans
+		//one world unit, so along axis a that reaches 0.01 * maxExtent / spacing_a voxels of this level.
+		glm::vec3 extent = PhysicalExtent();
+		double maxExtent = std::max(extent.x, std::max(extent.y, extent.z));
+		double minSpacing = std::min(image.SpacingX(), std::min(image.SpacingY(), image.SpacingZ()));
+		uint64_t reach = ceil(0.01 * maxExtent / minSpacing);
+		uint64_t dilation = (reach + cellSize - 1) / cellSize;
+		
+		MacrocellGrid* grid = Macrocells(level);
+		if(!grid->Build(image, cellSize, dilation))
+			continue;
+		OccupancyTexture(level)->Allocate(grid->CellsX(), grid->CellsY(), grid->CellsZ(), false, 1);
+	}
+	ClassifyMacrocells();
 	
-	std::cout << "VolumeData: Building gradient image" << std::endl; 
-	gradientImage.Allocate(intensityImage.Width(), intensityImage.Height(), intensityImage.Depth(), 3);
+	std::cout << "VolumeData: Macrocells of " << macrocells.CellsX() << "x" << macrocells.CellsY() << "x" << macrocells.CellsZ() << " built in " << SecondsSince(start) << "s" << std::endl; 
+}
+
+void VolumeData::ClassifyMacrocells()
+{
+	auto start = std::chrono::high_resolution_clock::now();
 	
-	gradientImage.Sobel(intensityImage);
+	std::vector<uint8_t> visible;
+	std::vector<uint8_t> distance;
+	for(int level = 0; level < PyramidLevels(); level++)
+	{
+		MacrocellGrid* grid = Macrocells(level);
+		if(grid->CellCount() == 0)
+			continue;
+		
+		//coarse RGB8 gradients are averages of full resolution ones and can exceed what the coarse
+		//intensities allow, those levels only skip on opacity
+		float threshold = level > 0 && gradientEncoding == GRADIENT_ENCODING_RGB8 ? 0.0f : gradientThreshold;
+		grid->Classify(lutOpaquePrefix, threshold, &visible);
+		grid->DistanceField(visible, &distance);
+		OccupancyTexture(level)->LoadDataSlab(distance.data(), 0, grid->CellsZ());
+	}
+	
+	std::cout << "VolumeData: Macrocells classified in " << SecondsSince(start) * 1e6 << "us" << std::endl; 
+}
+
+void VolumeData::SetLUTOpacity(std::vector<float>& opacity)
+{
+	//most curve edits only move colours or nonzero alphas, the cells stay as they are
+	std::vector<uint32_t> prefix;
+	MacrocellGrid::OpaquePrefix(opacity, &prefix);
+	if(prefix == lutOpaquePrefix)
+		return;
 	
-	std::cout << "VolumeData: Building gradient texture" << std::endl; 
-	textureGradient.Allocate(gradientImage.Width(), gradientImage.Height(), gradientImage.Depth(), false, 3);
-	textureGradient.LoadData(gradientImage.Data());
-}
\ No newline at end of file
+	lutOpaquePrefix.swap(prefix);
+	ClassifyMacrocells();
+}
+
+void VolumeData::SetGradientThreshold(float threshold)
+{
+	gradientThreshold = threshold;
+	ClassifyMacrocells();
+}
+
+MacrocellGrid* VolumeData::Macrocells(int level)
+{
+	if(level <= 0 || level >= PyramidLevels())
+		return &macrocells;
+	return &pyramidLevels[level - 1]->macrocells;
+}
+
+Texture3D* VolumeData::OccupancyTexture(int level)
+{
+	if(level <= 0 || level >= PyramidLevels())
+		return &textureOccupancy;
+	return &pyramidLevels[level - 1]->textureOccupancy;
+}
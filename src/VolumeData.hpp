@@ -2,24 +2,71 @@
 
 
 #include "Image3D.hpp"
+#include "MacrocellGrid.hpp"
 #include "Renderer/Texture3D.hpp"
 
+#include <memory>
+
+
+//One level of the LOD pyramid, every level halves the one before it. Level 0 is the full resolution
+//data held by VolumeData itself.
+struct VolumeLevel
+{
+	Image3D intensityImage;
+	Image3D gradientImage;
+	Texture3D textureVolume;
+	Texture3D textureGradient;
+	MacrocellGrid macrocells;
+	Texture3D textureOccupancy;
+};
+
 
 class VolumeData
 {
 	public:
+		Image3D sourceImage;
 		Image3D intensityImage;
 		Image3D gradientImage;
 		Texture3D textureVolume; 
 		Texture3D textureGradient; 
+		MacrocellGrid macrocells;
+		Texture3D textureOccupancy;//one byte per macrocell, distance in cells to the nearest one that may hold a surface
 		std::vector<float> textureVolumeHistogram;
+		std::vector<uint64_t> sourceHistogram;
+		std::vector<uint64_t> intensityHistogram;
+		std::vector<BrightnessContrastThresholdSettings> bctSteps;
+		std::vector<std::unique_ptr<VolumeLevel>> pyramidLevels;//levels 1 and up
+		GRADIENT_ENCODING gradientEncoding;
+		std::vector<uint32_t> lutOpaquePrefix;//summed nonzero alpha of the renderers' lookup table, see MacrocellGrid
+		float gradientThreshold;
+		double importSpacing;//isotropic voxel size imports are resampled to, 0 keeps the grid of the file
 		
 		VolumeData(); 
 		bool BuildFromImage3D();
+		void SetImportSpacing(double spacing);//applies to the next import
+		void ResampleForImport();
+		glm::vec3 PhysicalExtent();//size of the volume in the units of its voxel spacing
 		void ImportDicomFile(QString fileName);
 		void ImportDicomFileSequence(QStringList fileNames);
 		void ImportImageFile(QString fileName);
 		void ImportNRRDFile(QString fileName);
 		void ImportImageFileSequence(QStringList fileNames);
 		void ApplyBCTSettings(double b, double c, double t);
+		void UndoBCTSettings();
+		void ResetBCTSettings();
+		void RebuildFromBCTSettings();
+		void SetGradientEncoding(GRADIENT_ENCODING encoding);//rebuilds the gradient image and textures
+		void BuildPipelined(bool buildHistogram, bool copySource);
+		void BuildPyramid(DOWNSAMPLE_FILTER filter = DOWNSAMPLE_GAUSSIAN, uint64_t minSize = 32);//halves until the largest axis is below minSize
+		void ClearPyramid();
+		int PyramidLevels();//including level 0
+		int PyramidLevelForFootprint(double voxelsPerPixel);//voxelsPerPixel is measured at level 0
+		Texture3D* VolumeTexture(int level);
+		Texture3D* GradientTexture(int level);
+		void BuildMacrocells(uint64_t cellSize = 8);//all levels, classified with the current settings
+		void ClassifyMacrocells();
+		void SetLUTOpacity(std::vector<float>& opacity);
+		void SetGradientThreshold(float threshold);
+		MacrocellGrid* Macrocells(int level);
+		Texture3D* OccupancyTexture(int level);
 };
\ No newline at end of file